@@ -0,0 +1,543 @@
+/*
+  ==============================================================================
+
+    BankLoader.h
+    Created: 17 Oct 2026 12:58:44am
+    Author:  a931e
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <set>
+#include "MFMBank.h"
+
+/*
+ * Loads banks on a background thread so that no file system access or NPZ
+ * decoding happens on the audio or message thread. A finished bank is
+ * handed to onBankLoaded on the message thread; a request made while a load
+ * is in flight replaces it, and the stale load is dropped.
+ *
+ * While watching, the thread also polls the loaded directory. When note
+ * files are added, removed or rewritten, and the directory has looked the
+ * same for two polls in a row (so that a file being written is not read
+ * half-way), it builds the next bank from the previous one, decoding only
+ * the changed files.
+ *
+ * On demand, a load only lists the note files. A note is decoded the first
+ * time it is requested, see requestNote(), and published in a new bank;
+ * its neighbours within prefetchRadius follow in the next one. Until then
+ * the voices play the nearest loaded note, see MFMBank::findOrNearest().
+ * With a memory budget, the least recently played notes that no voice is
+ * sounding are unloaded again once the loaded notes exceed it.
+ */
+class BankLoader : private juce::Thread, private juce::AsyncUpdater
+{
+public:
+	struct Status
+	{
+		bool loading = false;
+		float progress = 0;
+		juce::String message;
+		bool failed = false;
+	};
+
+	BankLoader() : juce::Thread("MFM bank loader")
+	{
+	}
+
+	~BankLoader() override
+	{
+		cancelPendingUpdate();
+		stopThread(4000);
+	}
+
+	/** Called on the message thread with every bank that finished loading. */
+	std::function<void(std::shared_ptr<MFMBank>)> onBankLoaded;
+
+	static constexpr int prefetchRadius = 2;
+	static constexpr int numNotes = 128;
+
+	/**
+	 * Starts loading `directory`, whole or, `onDemand`, note by note; message
+	 * thread only.
+	 */
+	void load(const juce::String& directory, double sampleRate, bool onDemand = false)
+	{
+		{
+			const juce::ScopedLock sl(lock);
+			requestedDirectory = directory;
+			requestedSampleRate = sampleRate;
+			requestedOnDemand = onDemand;
+			requestId++;
+			status.loading = true;
+			status.progress = 0;
+			status.failed = false;
+			status.message = "Loading tables from " + directory;
+		}
+		if (!isThreadRunning()) {
+			startThread();
+		}
+		notify();
+	}
+
+	/**
+	 * Asks for a note of an on-demand bank, with its neighbours. Lock- and
+	 * allocation-free, for the audio thread; ignored for a whole bank.
+	 */
+	void requestNote(int midiNoteNumber)
+	{
+		if (!juce::isPositiveAndBelow(midiNoteNumber, numNotes)) {
+			return;
+		}
+		lastUsed[midiNoteNumber].store(++useCounter, std::memory_order_relaxed);
+		if (!requested[midiNoteNumber].load(std::memory_order_relaxed)) {
+			requested[midiNoteNumber].store(true, std::memory_order_relaxed);
+			anyRequested.store(true, std::memory_order_release);
+		}
+	}
+
+	/**
+	 * The notes whose tables the voices are playing, which are never
+	 * unloaded and count as just used; for the audio thread, after each
+	 * block.
+	 */
+	void setSoundingNotes(const std::array<bool, numNotes>& notes)
+	{
+		const bool anySounding = std::find(notes.begin(), notes.end(), true) != notes.end();
+		const juce::uint64 now = anySounding ? ++useCounter : 0;
+		for (int note = 0; note < numNotes; note++) {
+			if (sounding[note].load(std::memory_order_relaxed) != notes[note]) {
+				sounding[note].store(notes[note], std::memory_order_relaxed);
+			}
+			if (notes[note]) {
+				lastUsed[note].store(now, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	/**
+	 * Forgets the sounding notes once the voices are silenced, e.g. when
+	 * playback stops, so that the budget can unload them; message thread.
+	 */
+	void endPlayback()
+	{
+		for (auto& note : sounding) {
+			note.store(false, std::memory_order_relaxed);
+		}
+		notify();
+	}
+
+	/**
+	 * How the banks handed over fill notes that have no file; the current
+	 * bank is refilled on the loader thread, since blending takes a while.
+	 */
+	void setFillMode(MFMBank::FillMode mode)
+	{
+		fillMode = mode;
+		notify();
+	}
+
+	/**
+	 * The most the loaded notes of an on-demand bank may take, in bytes; 0
+	 * for no limit. A whole bank is never unloaded note by note.
+	 */
+	void setMemoryBudget(size_t bytes)
+	{
+		memoryBudget = bytes;
+	}
+
+	/** Polls the loaded directory for changed note files; on by default. */
+	void setWatching(bool shouldWatch)
+	{
+		watching = shouldWatch;
+		notify();
+	}
+
+	/** The sample rate the noise of the next banks is generated at. */
+	void setSampleRate(double sampleRate)
+	{
+		const juce::ScopedLock sl(lock);
+		requestedSampleRate = sampleRate;
+	}
+
+	/** Safe to call from the message thread at any time, e.g. from a timer. */
+	Status getStatus() const
+	{
+		const juce::ScopedLock sl(lock);
+		return status;
+	}
+
+private:
+	static constexpr int pollIntervalMs = 1000;
+	// how soon a requested note starts decoding
+	static constexpr int requestIntervalMs = 10;
+
+	enum class BuildKind { load, reload, notes };
+
+	void run() override
+	{
+		juce::uint64 doneId = 0;
+		// the last bank built and the scan of its directory that differs from it
+		std::shared_ptr<const MFMBank> latest;
+		MFMBank::FileMap pendingScan;
+		bool onDemand = false;
+		juce::uint32 lastPoll = 0;
+
+		while (!threadShouldExit()) {
+			juce::String directory;
+			double sampleRate;
+			juce::uint64 id;
+			{
+				const juce::ScopedLock sl(lock);
+				directory = requestedDirectory;
+				sampleRate = requestedSampleRate;
+				id = requestId;
+				onDemand = requestedOnDemand;
+			}
+
+			if (id != doneId) {
+				doneId = id;
+				pendingScan.clear();
+				// unchanged files of the same directory are reused
+				auto previous = latest != nullptr && latest->getDirectory() == directory ? latest : nullptr;
+				// on demand, only the notes already loaded stay loaded; a load
+				// asked for retries, and so reports again, the notes that failed
+				auto toLoad = getResidentNotes(previous.get());
+				if (previous != nullptr) {
+					for (const auto& failure : failed) {
+						toLoad.insert(failure.first);
+					}
+				}
+				failed.clear();
+				auto bank = buildBank(directory, sampleRate, id, previous.get(), nullptr, onDemand ? &toLoad : nullptr, BuildKind::load);
+				if (bank != nullptr) {
+					latest = bank;
+				}
+				continue;
+			}
+
+			if (onDemand && latest != nullptr && anyRequested.exchange(false, std::memory_order_acquire)) {
+				loadRequestedNotes(latest, sampleRate, id);
+			}
+			if (latest != nullptr && latest->getFillMode() != fillMode.load()) {
+				latest = handOver(latest->withFillMode(fillMode), id);
+			}
+			const size_t budget = memoryBudget;
+			if (onDemand && latest != nullptr && budget > 0 && latest->getResidentBytes() > budget) {
+				unloadToBudget(latest, sampleRate, id, budget);
+			}
+
+			const auto now = juce::Time::getMillisecondCounter();
+			if (watching && latest != nullptr && now - lastPoll >= (juce::uint32)pollIntervalMs) {
+				lastPoll = now;
+				try {
+					auto scan = MFMBank::scan(latest->getDirectory());
+					if (scan == latest->getFiles()) {
+						pendingScan.clear();
+					}
+					else if (scan != pendingScan) {
+						// still changing; look again at the next poll
+						pendingScan = std::move(scan);
+					}
+					else {
+						pendingScan.clear();
+						const auto resident = getResidentNotes(latest.get());
+						auto bank = buildBank(latest->getDirectory(), sampleRate, id, latest.get(), &scan,
+							onDemand ? &resident : nullptr, BuildKind::reload);
+						if (bank != nullptr) {
+							latest = bank;
+						}
+					}
+				}
+				catch (std::exception&) {
+					// the directory is gone or unreadable for now; keep the bank
+				}
+			}
+			if (onDemand && latest != nullptr) {
+				wait(requestIntervalMs);
+			}
+			else {
+				wait(watching && latest != nullptr ? pollIntervalMs : -1);
+			}
+		}
+	}
+
+	static std::set<int> getResidentNotes(const MFMBank* bank)
+	{
+		std::set<int> notes;
+		if (bank != nullptr) {
+			for (const auto& entry : bank->getParams()) {
+				notes.insert(entry.first);
+			}
+		}
+		return notes;
+	}
+
+	/**
+	 * Decodes the requested notes that are listed but not loaded yet and
+	 * publishes them, then does the same for their neighbours, which are
+	 * likely to be played next. Notes that failed are not tried again until
+	 * their file changes.
+	 */
+	void loadRequestedNotes(std::shared_ptr<const MFMBank>& latest, double sampleRate, juce::uint64 id)
+	{
+		auto isMissing = [&latest, this](int note) {
+			auto file = latest->getFiles().find(note);
+			auto failure = failed.find(note);
+			return file != latest->getFiles().end() && !latest->isResident(note)
+				&& (failure == failed.end() || failure->second != file->second);
+		};
+
+		std::set<int> notes, neighbours;
+		for (int note = 0; note < numNotes; note++) {
+			if (!requested[note].exchange(false, std::memory_order_relaxed)) {
+				continue;
+			}
+			if (isMissing(note)) {
+				notes.insert(note);
+			}
+			for (int distance = 1; distance <= prefetchRadius; distance++) {
+				for (int neighbour : { note - distance, note + distance }) {
+					if (isMissing(neighbour)) {
+						neighbours.insert(neighbour);
+					}
+				}
+			}
+		}
+
+		for (const auto* batch : { &notes, &neighbours }) {
+			auto toLoad = getResidentNotes(latest.get());
+			const size_t numResident = toLoad.size();
+			for (int note : *batch) {
+				if (isMissing(note)) {
+					toLoad.insert(note);
+				}
+			}
+			if (toLoad.size() == numResident) {
+				continue;
+			}
+			const auto files = latest->getFiles();
+			auto bank = buildBank(latest->getDirectory(), sampleRate, id, latest.get(), &files, &toLoad, BuildKind::notes);
+			if (bank == nullptr) {
+				return;
+			}
+			for (int note : toLoad) {
+				if (!latest->isResident(note) && bank->isResident(note)) {
+					// just loaded counts as just used, so a prefetch is not unloaded first
+					lastUsed[note].store(++useCounter, std::memory_order_relaxed);
+				}
+			}
+			latest = bank;
+		}
+	}
+
+	/**
+	 * Unloads the least recently used notes that no voice is sounding until
+	 * the loaded notes fit `budget`, and hands over the smaller bank. The
+	 * most recently used note stays even if it alone exceeds the budget.
+	 * Voices still holding an unloaded note keep its old bank alive until
+	 * they are done with it, see BankPublisher.
+	 */
+	void unloadToBudget(std::shared_ptr<const MFMBank>& latest, double sampleRate, juce::uint64 id, size_t budget)
+	{
+		std::vector<std::pair<juce::uint64, int>> candidates;
+		for (const auto& entry : latest->getParams()) {
+			const int note = entry.first;
+			if (!juce::isPositiveAndBelow(note, numNotes)) {
+				candidates.push_back({ 0, note });
+			}
+			else if (!sounding[note].load(std::memory_order_relaxed)) {
+				candidates.push_back({ lastUsed[note].load(std::memory_order_relaxed), note });
+			}
+		}
+		std::sort(candidates.begin(), candidates.end());
+		int newestNote = -1;
+		juce::uint64 newest = 0;
+		for (int note = 0; note < numNotes; note++) {
+			const auto used = lastUsed[note].load(std::memory_order_relaxed);
+			if (latest->isResident(note) && used >= newest) {
+				newest = used;
+				newestNote = note;
+			}
+		}
+
+		// blended notes count towards the budget but only go with the notes
+		// around them; if the smaller bank's blends still exceed it, the
+		// next pass unloads more
+		auto params = latest->getParams();
+		size_t bytes = latest->getResidentBytes();
+		int numUnloaded = 0;
+		for (const auto& candidate : candidates) {
+			if (bytes <= budget) {
+				break;
+			}
+			if (candidate.second == newestNote) {
+				continue;
+			}
+			bytes -= params.at(candidate.second)->getBytes();
+			params.erase(candidate.second);
+			numUnloaded++;
+		}
+		if (numUnloaded == 0) {
+			return;
+		}
+
+		auto bank = std::make_shared<MFMBank>(std::move(params), latest->getFiles(), latest->getDirectory(), sampleRate, fillMode);
+		const juce::ScopedLock sl(lock);
+		if (requestId != id) {
+			return;
+		}
+		status.message = "Unloaded " + juce::String(numUnloaded) + " notes to stay within "
+			+ juce::String(budget / (1024.0 * 1024.0), 1) + " MB, " + juce::String((int)bank->getParams().size())
+			+ " notes loaded from " + bank->getDirectory();
+		juce::Logger::writeToLog(status.message);
+		finished = bank;
+		triggerAsyncUpdate();
+		latest = bank;
+	}
+
+	/** Hands `bank` over unless a newer request came in; returns it either way. */
+	std::shared_ptr<const MFMBank> handOver(std::shared_ptr<MFMBank> bank, juce::uint64 id)
+	{
+		const juce::ScopedLock sl(lock);
+		if (requestId == id) {
+			finished = bank;
+			triggerAsyncUpdate();
+		}
+		return bank;
+	}
+
+	/**
+	 * Builds and hands over a bank for request `id`, reusing the unchanged
+	 * notes of `previous` and decoding only `notesToLoad` if given. Reports
+	 * the outcome in the status and returns the bank, or nullptr if it
+	 * failed or a newer request came in.
+	 */
+	std::shared_ptr<MFMBank> buildBank(const juce::String& directory, double sampleRate, juce::uint64 id,
+		const MFMBank* previous, const MFMBank::FileMap* scan, const std::set<int>* notesToLoad, BuildKind kind)
+	{
+		auto isStale = [this, id] {
+			const juce::ScopedLock sl(lock);
+			return threadShouldExit() || requestId != id;
+		};
+
+		const bool reload = scan != nullptr;
+		if (kind == BuildKind::reload) {
+			const juce::ScopedLock sl(lock);
+			status.loading = true;
+			status.progress = 0;
+			status.message = "Reloading changed tables from " + directory;
+		}
+
+		juce::StringArray errors;
+		std::shared_ptr<MFMBank> bank;
+		size_t numChanged = 0;
+		try {
+			const auto files = reload ? *scan : MFMBank::scan(directory);
+			for (const auto& file : files) {
+				if (previous == nullptr || previous->getFiles().count(file.first) == 0 || previous->getFiles().at(file.first) != file.second) {
+					numChanged++;
+				}
+			}
+			if (previous != nullptr) {
+				for (const auto& file : previous->getFiles()) {
+					numChanged += files.count(file.first) == 0 ? 1 : 0;
+				}
+			}
+			bank = MFMBank::build(directory, files, sampleRate, previous, errors,
+				[this, kind](float progress) {
+					const juce::ScopedLock sl(lock);
+					if (kind != BuildKind::notes) {
+						status.progress = progress;
+					}
+				},
+				isStale, notesToLoad, &failed);
+			if (bank != nullptr && fillMode != MFMBank::FillMode::none) {
+				bank = bank->withFillMode(fillMode);
+			}
+		}
+		catch (std::exception& e) {
+			errors.add(e.what());
+		}
+
+		const juce::ScopedLock sl(lock);
+		if (requestId != id) {
+			return nullptr;
+		}
+		status.loading = false;
+		status.progress = 1;
+		if (bank == nullptr) {
+			status.failed = true;
+			status.message = "Error loading tables from " + directory + ": " + errors.joinIntoString("; ");
+			return nullptr;
+		}
+		status.failed = !errors.isEmpty();
+		if (kind == BuildKind::notes) {
+			status.message = "Loaded on demand: ";
+		}
+		else {
+			status.message = kind == BuildKind::reload ? "Reloaded " + juce::String((int)numChanged) + " changed files, " : juce::String("Loaded ");
+		}
+		status.message += juce::String((int)bank->getParams().size()) + " notes from " + directory;
+		if (notesToLoad != nullptr) {
+			status.message += " (" + juce::String((int)bank->getFiles().size()) + " listed)";
+		}
+		// a note that was decoded and is not resident failed
+		for (const auto& file : bank->getFiles()) {
+			if (bank->isResident(file.first)) {
+				failed.erase(file.first);
+			}
+			else if (file.first != MFMBank::packedBankKey && (notesToLoad == nullptr || notesToLoad->count(file.first) != 0)) {
+				failed[file.first] = file.second;
+			}
+		}
+		if (!errors.isEmpty()) {
+			status.message += " (" + juce::String(errors.size()) + " failed: " + errors.joinIntoString("; ") + ")";
+		}
+		juce::Logger::writeToLog(status.message);
+		finished = bank;
+		triggerAsyncUpdate();
+		return bank;
+	}
+
+	void handleAsyncUpdate() override
+	{
+		std::shared_ptr<MFMBank> bank;
+		{
+			const juce::ScopedLock sl(lock);
+			bank.swap(finished);
+		}
+		if (bank != nullptr && onBankLoaded) {
+			onBankLoaded(std::move(bank));
+		}
+	}
+
+	juce::CriticalSection lock;
+	juce::String requestedDirectory;
+	double requestedSampleRate = 0;
+	juce::uint64 requestId = 0;
+	bool requestedOnDemand = false;
+	std::atomic<bool> watching{ true };
+	std::atomic<bool> requested[numNotes] = {};
+	std::atomic<bool> anyRequested{ false };
+	std::atomic<bool> sounding[numNotes] = {};
+	// a use counter value per note, for least-recently-used unloading
+	std::atomic<juce::uint64> useCounter{ 0 };
+	std::atomic<juce::uint64> lastUsed[numNotes] = {};
+	std::atomic<size_t> memoryBudget{ 0 };
+	std::atomic<MFMBank::FillMode> fillMode{ MFMBank::FillMode::none };
+	// the notes of the latest directory whose file failed to decode, as it
+	// was then, and is not tried again until it changes, is asked for or the
+	// directory is loaded again; loader thread only. Notes that are listed
+	// but were never decoded are not in it.
+	MFMBank::FileMap failed;
+	Status status;
+	std::shared_ptr<MFMBank> finished;
+};
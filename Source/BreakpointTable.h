@@ -0,0 +1,152 @@
+/*
+  ==============================================================================
+
+    BreakpointTable.h
+    Created: 17 Oct 2026 5:36:52am
+    Author:  a931e
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "LoopTable.h"
+
+/*
+ * One of a note's looped tables with every partial's track replaced by a
+ * piecewise-linear curve that passes within a tolerance of each frame. A
+ * segment grows from its start for as long as some line through the start
+ * still passes within the tolerance of every frame it covers ("swing door"
+ * fitting), so tracks that are flat or straight for long stretches shrink
+ * to a handful of breakpoints.
+ *
+ * The breakpoints of partial p are [getFirst(p), getFirst(p + 1)): the first
+ * at frame 0, the last at the table's guard frame, so the LoopTable's cursor
+ * arithmetic still applies. Readers keep a segment per partial that only
+ * moves forwards while their frame cursor does, see load(); it is looked up
+ * again only when the cursor wraps back into the loop.
+ */
+class BreakpointTable
+{
+public:
+	BreakpointTable() {}
+
+	BreakpointTable(const BreakpointTable&) = delete;
+	BreakpointTable& operator=(const BreakpointTable&) = delete;
+
+	/** Fits every partial of `table` to within `tolerance` times the partial's largest |value|. */
+	void build(const LoopTable& table, float tolerance)
+	{
+		numPartials = table.getNumPartials();
+		firsts.assign(1, 0);
+		frames.clear();
+		values.clear();
+		for (int p = 0; p < numPartials; p++) {
+			fit(table.getPartial(p), table.getLength(), tolerance * table.getMaxAbs(p));
+			firsts.push_back((int)frames.size());
+		}
+		frames.shrink_to_fit();
+		values.shrink_to_fit();
+	}
+
+	void clear()
+	{
+		firsts.clear();
+		frames.clear();
+		values.clear();
+		firsts.shrink_to_fit();
+		frames.shrink_to_fit();
+		values.shrink_to_fit();
+		numPartials = 0;
+	}
+
+	bool isEmpty() const { return frames.empty(); }
+
+	/**
+	 * The values of the first `count` partials at `frame` and their slopes
+	 * towards the next frame, moving each partial's cursor in `segments`
+	 * along. A cursor that does not point into the partial's breakpoints,
+	 * such as -1 for a new note, is looked up.
+	 */
+	void load(int frame, int* segments, float* start, float* slope, int count) const
+	{
+		for (int p = 0; p < count; p++) {
+			int k = segments[p];
+			if (k < firsts[p] || k >= firsts[p + 1] - 1 || frame < frames[k]) {
+				k = findSegment(p, frame);
+			}
+			while (k + 2 < firsts[p + 1] && frame >= frames[k + 1]) {
+				k++;
+			}
+			segments[p] = k;
+			const float s = (values[k + 1] - values[k]) / (float)(frames[k + 1] - frames[k]);
+			start[p] = values[k] + s * (float)(frame - frames[k]);
+			slope[p] = s;
+		}
+	}
+
+	/** A partial's value at a fractional frame cursor; looks the segment up. */
+	float interpolate(int p, double position) const
+	{
+		const int k = findSegment(p, (int)position);
+		return values[k] + (values[k + 1] - values[k]) * (float)((position - frames[k]) / (frames[k + 1] - frames[k]));
+	}
+
+	int getFirst(int p) const { return firsts[p]; }
+	int getNumBreakpoints() const { return (int)frames.size(); }
+
+	size_t getBytes() const
+	{
+		return frames.capacity() * sizeof(int32_t) + values.capacity() * sizeof(float) + firsts.capacity() * sizeof(int);
+	}
+
+private:
+	void fit(const float* track, int length, float tolerance)
+	{
+		int start = 0;
+		float startValue = track[0];
+		frames.push_back(0);
+		values.push_back(startValue);
+		while (start < length - 1) {
+			// the slopes of the lines from the start that pass every frame so far
+			float low = -std::numeric_limits<float>::infinity();
+			float high = std::numeric_limits<float>::infinity();
+			int end = start + 1;
+			for (int j = start + 1; j < length; j++) {
+				const float distance = (float)(j - start);
+				const float lower = std::max(low, (track[j] - tolerance - startValue) / distance);
+				const float upper = std::min(high, (track[j] + tolerance - startValue) / distance);
+				if (lower > upper) {
+					break;
+				}
+				low = lower;
+				high = upper;
+				end = j;
+			}
+			// of those, the one closest to the frame at the end
+			const float slope = juce::jlimit(low, high, (track[end] - startValue) / (float)(end - start));
+			startValue += slope * (float)(end - start);
+			start = end;
+			frames.push_back(start);
+			values.push_back(startValue);
+		}
+	}
+
+	// the segment of partial p that holds `frame`: the last breakpoint at or before it, short of the last one
+	int findSegment(int p, int frame) const
+	{
+		const auto begin = frames.begin() + firsts[p];
+		const auto end = frames.begin() + firsts[p + 1] - 1;
+		return (int)(std::upper_bound(begin, end, frame) - frames.begin()) - 1;
+	}
+
+	std::vector<int> firsts;
+	std::vector<int32_t> frames;
+	std::vector<float> values;
+	int numPartials = 0;
+};
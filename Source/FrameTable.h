@@ -0,0 +1,373 @@
+/*
+  ==============================================================================
+
+    FrameTable.h
+    Created: 17 Oct 2026 4:21:09am
+    Author:  a931e
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <cstdint>
+#include "SIMD.h"
+#include "LoopTable.h"
+#include "BreakpointTable.h"
+
+/*
+ * The four looped tables a voice reads (magGlobal, alphaGlobal and the two
+ * alphaLocal envelopes) transposed to frame-major order, one row per frame:
+ *
+ *   row f: mag[0, P) | alphaGlobal[0, P) | env1[0, P) | env2[0, P)
+ *
+ * with each block padded to a whole number of cache lines. Loading a frame
+ * then reads two adjacent rows, a single contiguous stream, instead of one
+ * cache line per partial and table, and the blocks line up with the
+ * structure-of-arrays partials for aligned vector loads.
+ *
+ * Each quantity is stored as float32 or, to halve its size and the bytes a
+ * frame load reads, as float16 or as int16 scaled per partial by the
+ * partial's largest |value|; see Format. decode() widens a block back to
+ * floats. A quantity can also be fitted with breakpoints instead, see
+ * BreakpointTable, and then takes no space in the rows.
+ *
+ * Rows follow the frames of the LoopTables it is built from, loop and guard
+ * frame included, so the LoopTables' cursor arithmetic (wrap()) still
+ * applies.
+ */
+class FrameTable
+{
+public:
+	enum Quantity { mag, alphaGlobal, env1, env2, numQuantities };
+
+	enum class Encoding { float32, float16, int16, breakpoints };
+
+	/**
+	 * Whether a note's loop tables are moved into a FrameTable or left
+	 * partial-major in its LoopTables. `KernelBench frames` (Tools/KernelBench)
+	 * timed a frame load of 128 partials, 16 voices on 16 notes, on a Xeon VM
+	 * at 4.2 us partial-major, 0.34 us frame-major float32 and 0.17 us
+	 * float16, so frame-major is the default.
+	 */
+	enum class Layout { partialMajor, frameMajor };
+
+	// breakpoint fitting error, relative to each partial's largest |value|
+	static constexpr float defaultTolerance = 0.001f;
+
+	/** How each quantity is stored; frame-major float32 throughout unless a bank asks otherwise. */
+	struct Format
+	{
+		Layout layout = Layout::frameMajor;
+		Encoding encodings[numQuantities] = { Encoding::float32, Encoding::float32, Encoding::float32, Encoding::float32 };
+		// for Encoding::breakpoints
+		float tolerances[numQuantities] = { defaultTolerance, defaultTolerance, defaultTolerance, defaultTolerance };
+
+		bool operator==(const Format& other) const
+		{
+			return layout == other.layout && std::equal(encodings, encodings + numQuantities, other.encodings)
+				&& std::equal(tolerances, tolerances + numQuantities, other.tolerances);
+		}
+		bool operator!=(const Format& other) const { return !(*this == other); }
+
+		juce::String toString() const
+		{
+			static const char* names[numQuantities] = { "magGlobal", "alphaGlobal", "alphaLocalEnv1", "alphaLocalEnv2" };
+			juce::StringArray fields;
+			fields.add(juce::String("layout = ") + getName(layout));
+			for (int q = 0; q < numQuantities; q++) {
+				fields.add(juce::String(names[q]) + " = " + getName(encodings[q])
+					+ (encodings[q] == Encoding::breakpoints ? " " + juce::String(tolerances[q]) : juce::String()));
+			}
+			return fields.joinIntoString(", ");
+		}
+
+		/**
+		 * Reads `<array> = <encoding>` lines, where array is magGlobal,
+		 * alphaGlobal or alphaLocalEnv (both envelopes) and encoding float32,
+		 * float16, int16 or breakpoints, optionally followed by the tolerance,
+		 * and a `layout = frameMajor` or `layout = partialMajor` line;
+		 * empty lines and lines starting with # are skipped. Encodings other
+		 * than float32 only exist frame-major, so they cannot be combined with
+		 * `layout = partialMajor`.
+		 * Returns false, with `error` set, at the first line it does not
+		 * understand or if the lines contradict each other.
+		 */
+		static bool parse(const juce::String& text, Format& format, juce::String& error)
+		{
+			for (const auto& rawLine : juce::StringArray::fromLines(text)) {
+				const auto line = rawLine.trim();
+				if (line.isEmpty() || line.startsWith("#")) {
+					continue;
+				}
+				const auto name = line.upToFirstOccurrenceOf("=", false, false).trim();
+				const auto fields = juce::StringArray::fromTokens(line.fromFirstOccurrenceOf("=", false, false).trim(), false);
+				const auto value = fields.isEmpty() ? juce::String() : fields[0];
+				if (name == "layout") {
+					if (fields.size() == 1 && value == getName(Layout::frameMajor)) {
+						format.layout = Layout::frameMajor;
+					}
+					else if (fields.size() == 1 && value == getName(Layout::partialMajor)) {
+						format.layout = Layout::partialMajor;
+					}
+					else {
+						error = "unknown layout in \"" + line + "\"";
+						return false;
+					}
+					continue;
+				}
+				Encoding encoding;
+				float tolerance = defaultTolerance;
+				if (value == getName(Encoding::breakpoints) && fields.size() <= 2) {
+					encoding = Encoding::breakpoints;
+					tolerance = fields.size() == 2 ? fields[1].getFloatValue() : defaultTolerance;
+					if (!(tolerance >= 0)) {
+						error = "bad tolerance in \"" + line + "\"";
+						return false;
+					}
+				}
+				else if (fields.size() != 1) {
+					error = "unknown encoding in \"" + line + "\"";
+					return false;
+				}
+				else if (value == getName(Encoding::float32)) {
+					encoding = Encoding::float32;
+				}
+				else if (value == getName(Encoding::float16)) {
+					encoding = Encoding::float16;
+				}
+				else if (value == getName(Encoding::int16)) {
+					encoding = Encoding::int16;
+				}
+				else {
+					error = "unknown encoding in \"" + line + "\"";
+					return false;
+				}
+
+				if (name == "magGlobal") {
+					format.set(mag, encoding, tolerance);
+				}
+				else if (name == "alphaGlobal") {
+					format.set(alphaGlobal, encoding, tolerance);
+				}
+				else if (name == "alphaLocalEnv") {
+					format.set(env1, encoding, tolerance);
+					format.set(env2, encoding, tolerance);
+				}
+				else {
+					error = "unknown array in \"" + line + "\"";
+					return false;
+				}
+			}
+			if (format.layout == Layout::partialMajor && !format.isFloat32()) {
+				error = "encodings other than float32 need layout = frameMajor";
+				return false;
+			}
+			return true;
+		}
+
+		bool isFloat32() const
+		{
+			return std::all_of(encodings, encodings + numQuantities, [](Encoding e) { return e == Encoding::float32; });
+		}
+
+		static const char* getName(Encoding encoding)
+		{
+			switch (encoding) {
+			case Encoding::float16: return "float16";
+			case Encoding::int16: return "int16";
+			case Encoding::breakpoints: return "breakpoints";
+			default: return "float32";
+			}
+		}
+
+		static const char* getName(Layout layout)
+		{
+			return layout == Layout::partialMajor ? "partialMajor" : "frameMajor";
+		}
+
+		void set(Quantity quantity, Encoding encoding, float tolerance)
+		{
+			encodings[quantity] = encoding;
+			tolerances[quantity] = tolerance;
+		}
+	};
+
+	// bytes per cache line; blocks start on one
+	static constexpr int blockAlignment = 64;
+
+	FrameTable() {}
+
+	FrameTable(const FrameTable&) = delete;
+	FrameTable& operator=(const FrameTable&) = delete;
+
+	/** Transposes four tables of the same geometry; returns false, leaving this empty, if they differ. */
+	bool build(const LoopTable& magTable, const LoopTable& alphaGlobalTable, const LoopTable& env1Table, const LoopTable& env2Table,
+		const Format& format)
+	{
+		const LoopTable* tables[numQuantities] = { &magTable, &alphaGlobalTable, &env1Table, &env2Table };
+		for (const auto* table : tables) {
+			if (!table->hasData() || table->getLength() != magTable.getLength() || table->getNumPartials() != magTable.getNumPartials()) {
+				storage.free();
+				scales.free();
+				length = 0;
+				return false;
+			}
+		}
+
+		this->format = format;
+		numPartials = magTable.getNumPartials();
+		length = magTable.getLength();
+		rowBytes = 0;
+		for (int q = 0; q < numQuantities; q++) {
+			blockOffsets[q] = rowBytes;
+			rowBytes += align((size_t)numPartials * getElementSize(format.encodings[q]));
+		}
+		storage.allocate((size_t)length * rowBytes / sizeof(float));
+		scaleStride = simd::padToWidth(numPartials);
+		scales.allocate((size_t)numQuantities * scaleStride);
+
+		for (int q = 0; q < numQuantities; q++) {
+			const Encoding encoding = format.encodings[q];
+			if (encoding == Encoding::breakpoints) {
+				breakpoints[q].build(*tables[q], format.tolerances[q]);
+				continue;
+			}
+			breakpoints[q].clear();
+			for (int p = 0; p < numPartials; p++) {
+				// int16 spans the partial's range; a silent partial stays 0
+				const float scale = tables[q]->getMaxAbs(p) / 32767.0f;
+				scales[(size_t)q * scaleStride + p] = scale;
+
+				const float* source = tables[q]->getPartial(p);
+				for (int f = 0; f < length; f++) {
+					char* block = getBlock(f, (Quantity)q);
+					if (encoding == Encoding::float16) {
+						reinterpret_cast<uint16_t*>(block)[p] = simd::floatToHalf(source[f]);
+					}
+					else if (encoding == Encoding::int16) {
+						reinterpret_cast<int16_t*>(block)[p] = (int16_t)(scale > 0 ? juce::jlimit(-32767, 32767, juce::roundToInt(source[f] / scale)) : 0);
+					}
+					else {
+						reinterpret_cast<float*>(block)[p] = source[f];
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	bool isEmpty() const { return length == 0; }
+
+	bool hasBreakpoints(Quantity quantity) const { return format.encodings[quantity] == Encoding::breakpoints; }
+
+	/** The fitted tracks of a quantity stored as breakpoints. */
+	const BreakpointTable& getBreakpoints(Quantity quantity) const { return breakpoints[quantity]; }
+
+	/**
+	 * Widens a quantity at a frame to floats for the first `count` partials,
+	 * `count` a multiple of simd::width no larger than simd::padToWidth() of
+	 * the partials. `values` must be aligned; lanes past the partials get 0.
+	 * Not for quantities stored as breakpoints.
+	 */
+	void decode(int frame, Quantity quantity, float* values, int count) const
+	{
+		using namespace simd;
+		jassert(!hasBreakpoints(quantity));
+		const char* block = getBlock(frame, quantity);
+		switch (format.encodings[quantity]) {
+		case Encoding::float16: {
+			const auto* halves = reinterpret_cast<const uint16_t*>(block);
+			for (int i = 0; i < count; i += width) {
+				store(values + i, loadHalf(halves + i));
+			}
+			break;
+		}
+		case Encoding::int16: {
+			const auto* ints = reinterpret_cast<const int16_t*>(block);
+			const float* scale = scales.get() + (size_t)quantity * scaleStride;
+			for (int i = 0; i < count; i += width) {
+				store(values + i, mul(loadInt16(ints + i), load(scale + i)));
+			}
+			break;
+		}
+		default: {
+			const auto* floats = reinterpret_cast<const float*>(block);
+			for (int i = 0; i < count; i += width) {
+				store(values + i, load(floats + i));
+			}
+			break;
+		}
+		}
+	}
+
+	/** A partial's value at a frame. */
+	float getValue(int frame, Quantity quantity, int p) const
+	{
+		if (hasBreakpoints(quantity)) {
+			return breakpoints[quantity].interpolate(p, frame);
+		}
+		const char* block = getBlock(frame, quantity);
+		switch (format.encodings[quantity]) {
+		case Encoding::float16: return simd::halfToFloat(reinterpret_cast<const uint16_t*>(block)[p]);
+		case Encoding::int16: return reinterpret_cast<const int16_t*>(block)[p] * scales[(size_t)quantity * scaleStride + p];
+		default: return reinterpret_cast<const float*>(block)[p];
+		}
+	}
+
+	/** A partial's value at a fractional frame cursor. */
+	float interpolate(Quantity quantity, int p, double position) const
+	{
+		if (hasBreakpoints(quantity)) {
+			return breakpoints[quantity].interpolate(p, position);
+		}
+		const int frame = (int)position;
+		const float a = getValue(frame, quantity, p);
+		const float b = getValue(frame + 1, quantity, p);
+		return a + (b - a) * (float)(position - frame);
+	}
+
+	int getNumPartials() const { return numPartials; }
+	int getLength() const { return length; }
+	const Format& getFormat() const { return format; }
+
+	size_t getBytes() const
+	{
+		size_t bytes = (storage.getSize() + scales.getSize()) * sizeof(float);
+		for (const auto& table : breakpoints) {
+			bytes += table.getBytes();
+		}
+		return bytes;
+	}
+
+	/** Bytes per partial in a row; breakpoints are kept outside the rows. */
+	static int getElementSize(Encoding encoding)
+	{
+		switch (encoding) {
+		case Encoding::float32: return (int)sizeof(float);
+		case Encoding::breakpoints: return 0;
+		default: return (int)sizeof(int16_t);
+		}
+	}
+
+private:
+	static size_t align(size_t bytes) { return (bytes + blockAlignment - 1) / blockAlignment * blockAlignment; }
+
+	char* getBlock(int frame, Quantity quantity) const
+	{
+		return reinterpret_cast<char*>(storage.get()) + (size_t)frame * rowBytes + blockOffsets[quantity];
+	}
+
+	AlignedBuffer storage;
+	// per quantity, the int16 step of each partial
+	AlignedBuffer scales;
+	BreakpointTable breakpoints[numQuantities];
+	Format format;
+	size_t blockOffsets[numQuantities] = {};
+	size_t rowBytes = 0;
+	int scaleStride = 0;
+	int numPartials = 0;
+	int length = 0;
+};
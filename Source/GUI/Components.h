@@ -122,10 +122,18 @@ public:
 		/*addAndMakeVisible(serverAddress);
 		addAndMakeVisible(imagesDirectory);*/
 		addAndMakeVisible(tableDirectory);
+		addAndMakeVisible(loadOnDemandToggle);
+		addAndMakeVisible(fillMissingToggle);
+		addAndMakeVisible(blendMissingToggle);
+		addAndMakeVisible(memoryBudget);
 		addAndMakeVisible(applySettingsButton);
 		addAndMakeVisible(statusText);
 		addAndMakeVisible(lastMidiMessageText);
+		addAndMakeVisible(renderLoadText);
 		addAndMakeVisible(versionText);
+		addAndMakeVisible(memoryReport);
+		memoryReport.setMultiLine(true);
+		memoryReport.setReadOnly(true);
 		versionText.setText("MFM Synth Version: " MFM_VERSION, juce::dontSendNotification);
 		auto applySettingsCallback = [this]() {
 
@@ -148,13 +156,8 @@ public:
 					return;
 				}
 			}
-			try{
-				this->p.loadParams();
-			}
-			catch (std::exception e) {
-				statusText.setText("Error loading params from" + this->p.getState("TableDirectory"), juce::dontSendNotification);
-				return;
-			}
+			// the tables load in the background; timerCallback() shows the progress
+			this->p.loadParams();
 			try {
 				this->p.startNetworkThread();
 			}
@@ -162,11 +165,28 @@ public:
 				statusText.setText("Error connecting to server.", juce::dontSendNotification);
 				return;
 			}
-			statusText.setText("Done.", juce::dontSendNotification);
 		};
 		statusText.setText("Load table before using the synth.", juce::dontSendNotification);
 
 		applySettingsButton.onClick = applySettingsCallback;
+
+		// takes effect with the next load
+		loadOnDemandToggle.setToggleState(p.getState("LoadNotesOnDemand") == "1", juce::dontSendNotification);
+		loadOnDemandToggle.onClick = [this]() {
+			this->p.setState("LoadNotesOnDemand", loadOnDemandToggle.getToggleState() ? "1" : "0");
+		};
+
+		// keys without a table borrow the nearest one, or a blend of the two around them; applies at once
+		const auto fillMode = p.getState("FillMissingNotes");
+		fillMissingToggle.setToggleState(fillMode == "nearest" || fillMode == "interpolate", juce::dontSendNotification);
+		blendMissingToggle.setToggleState(fillMode == "interpolate", juce::dontSendNotification);
+		auto updateFillMode = [this]() {
+			const bool fill = fillMissingToggle.getToggleState();
+			this->p.setState("FillMissingNotes", !fill ? "none" : blendMissingToggle.getToggleState() ? "interpolate" : "nearest");
+			this->p.updateFillMode();
+		};
+		fillMissingToggle.onClick = updateFillMode;
+		blendMissingToggle.onClick = updateFillMode;
 	}
 
 	void paint(juce::Graphics& g) override
@@ -179,11 +199,17 @@ public:
 		/*fb.items.add(FlexItem(serverAddress).withFlex(1).withMargin(5));
 		fb.items.add(FlexItem(imagesDirectory).withFlex(1).withMargin(5));*/
 		fb.items.add(FlexItem(tableDirectory).withFlex(1).withMargin(5));
+		fb.items.add(FlexItem(loadOnDemandToggle).withFlex(0.5).withMargin(5));
+		fb.items.add(FlexItem(fillMissingToggle).withFlex(0.5).withMargin(5));
+		fb.items.add(FlexItem(blendMissingToggle).withFlex(0.5).withMargin(5));
+		fb.items.add(FlexItem(memoryBudget).withFlex(1).withMargin(5));
 		fb.items.add(FlexItem(applySettingsButton).withFlex(1).withMargin(5));
 		fb.items.add(FlexItem(statusText).withFlex(1).withMargin(2));
 		fb.items.add(FlexItem(lastMidiMessageText).withFlex(1).withMargin(2));
+		fb.items.add(FlexItem(renderLoadText).withFlex(1).withMargin(2));
 		fb.items.add(FlexItem(versionText).withFlex(1).withMargin(5));
-		fb.performLayout(getLocalBounds().withHeight(400));
+		fb.performLayout(getLocalBounds().withHeight(540));
+		memoryReport.setBounds(getLocalBounds().withTrimmedTop(540).reduced(5));
 	}
 	void timerCallback() override
 	{
@@ -191,16 +217,37 @@ public:
 			lastMidiMessage = p.lastMidiMessage;
 			lastMidiMessageText.setText(lastMidiMessage, juce::dontSendNotification);
 		}
+		const auto bankStatus = p.getBankLoadStatus();
+		if (bankStatus.loading) {
+			statusText.setText(bankStatus.message + " (" + juce::String(juce::roundToInt(bankStatus.progress * 100)) + "%)", juce::dontSendNotification);
+		}
+		else if (bankStatus.message.isNotEmpty()) {
+			statusText.setText(bankStatus.message, juce::dontSendNotification);
+		}
+		renderLoadText.setText("Render load: " + juce::String(juce::roundToInt(p.getRenderLoad() * 100)) + "%, detail level "
+			+ juce::String(p.getRenderDetailLevel()), juce::dontSendNotification);
+		// the report walks every note; once a second is enough
+		if (++ticksSinceMemoryReport >= 10) {
+			ticksSinceMemoryReport = 0;
+			memoryReport.setText(p.getMemoryFootprint().describe(), juce::dontSendNotification);
+		}
 	}
 private:
 	PhysicsBasedSynthAudioProcessor& p;
 	InputBoxWithLabel serverAddress = InputBoxWithLabel("ServerUrl", "ServerUrl", p.valueTree.state);
 	InputBoxWithLabel imagesDirectory = InputBoxWithLabel("ImagesDirectory", "ImagesDirectory", p.valueTree.state);
 	InputBoxWithLabel tableDirectory = InputBoxWithLabel("TableDirectory", "TableDirectory", p.valueTree.state);
+	juce::ToggleButton loadOnDemandToggle = juce::ToggleButton("Load notes on demand");
+	juce::ToggleButton fillMissingToggle = juce::ToggleButton("Play missing notes from the nearest table");
+	juce::ToggleButton blendMissingToggle = juce::ToggleButton("Blend the tables around missing notes");
+	InputBoxWithLabel memoryBudget = InputBoxWithLabel("Memory budget for notes on demand (MB)", "MemoryBudgetMB", p.valueTree.state);
+	juce::TextEditor memoryReport;
+	int ticksSinceMemoryReport = 10;
 	juce::TextButton applySettingsButton = juce::TextButton("Load table");
 	//status text
 	juce::Label statusText;
 	juce::Label lastMidiMessageText;
 	juce::String lastMidiMessage;
+	juce::Label renderLoadText;
 	juce::Label versionText;
 };
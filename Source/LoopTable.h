@@ -0,0 +1,211 @@
+/*
+  ==============================================================================
+
+    LoopTable.h
+    Created: 16 Oct 2026 1:05:47pm
+    Author:  a931e
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <memory>
+#include <vector>
+
+/*
+ * A partial-major [partial][frame] parameter table unrolled for looped playback
+ * at the parameter sample rate. Each partial holds
+ *
+ *   source[0, loopEnd) | crossfaded loop body [0, loopLength) | guard frame
+ *
+ * where the first `overlap` frames of the body fade from the frames after
+ * loopEnd into the frames after loopStart. A reader advances a fractional
+ * frame cursor and subtracts loopLength when it reaches getWrapPosition(); the
+ * frame after any readable frame always exists, so linear interpolation needs
+ * no bounds checks.
+ *
+ * Built once per MFMParam and shared read-only by every voice, or viewed in
+ * place in a packed bank file, see view().
+ */
+class LoopTable
+{
+public:
+	LoopTable() {}
+
+	// a copy would point into the original's storage
+	LoopTable(const LoopTable&) = delete;
+	LoopTable& operator=(const LoopTable&) = delete;
+	LoopTable(LoopTable&&) = default;
+	LoopTable& operator=(LoopTable&&) = default;
+
+	/**
+	 * @param sourceStride  distance between the rows of consecutive partials
+	 * @param loopStart, loopEnd, overlap  in frames of the source
+	 */
+	void build(const float* source, int numPartials, int numSamples, int sourceStride, int loopStart, int loopEnd, int overlap)
+	{
+		jassert(numSamples > 0);
+		loopEnd = juce::jlimit(0, numSamples, loopEnd);
+		loopStart = juce::jlimit(0, loopEnd, loopStart);
+		loopLength = loopEnd - loopStart;
+		overlap = juce::jlimit(0, loopLength, overlap);
+		if (loopLength == 0) {
+			// too short to loop: play the source and hold its last frame
+			loopEnd = numSamples;
+		}
+
+		this->loopEnd = loopEnd;
+		this->numPartials = numPartials;
+		length = loopEnd + loopLength + 1;
+		owner.reset();
+		storage.assign((size_t)numPartials * length, 0.0f);
+		data = storage.data();
+
+		for (int p = 0; p < numPartials; p++) {
+			const float* src = source + (size_t)p * sourceStride;
+			auto at = [src, numSamples](int i) { return src[std::min(i, numSamples - 1)]; };
+			float* dst = storage.data() + (size_t)p * length;
+
+			for (int i = 0; i < loopEnd; i++) {
+				dst[i] = src[i];
+			}
+			for (int k = 0; k < loopLength; k++) {
+				float value = at(loopStart + k);
+				if (k < overlap) {
+					const float lerp = (float)k / overlap;
+					value = value * lerp + at(loopEnd + k) * (1 - lerp);
+				}
+				dst[loopEnd + k] = value;
+			}
+			dst[length - 1] = loopLength > 0 ? dst[loopEnd] : dst[loopEnd - 1];
+		}
+		computeBounds();
+	}
+
+	/**
+	 * A table with the geometry of `shape` and `numPartials` partials, frame
+	 * f of partial p being `at(p, f)`; e.g. a mix of tables of that geometry.
+	 */
+	template <typename Value>
+	void build(const LoopTable& shape, int numPartials, Value at)
+	{
+		loopEnd = shape.loopEnd;
+		loopLength = shape.loopLength;
+		length = shape.length;
+		this->numPartials = numPartials;
+		owner.reset();
+		storage.assign((size_t)numPartials * length, 0.0f);
+		data = storage.data();
+		for (int p = 0; p < numPartials; p++) {
+			for (int f = 0; f < length; f++) {
+				storage[(size_t)p * length + f] = at(p, f);
+			}
+		}
+		computeBounds();
+	}
+
+	/**
+	 * Uses a table laid out as build() lays it out, with its per-partial
+	 * bounds, from memory that `owner` keeps alive (e.g. a mapped file).
+	 */
+	void view(std::shared_ptr<const void> owner, const float* data, const float* maxAbs, const float* maxAbsSlope,
+		int numPartials, int length, int loopEnd, int loopLength)
+	{
+		jassert(length == loopEnd + loopLength + 1);
+		this->owner = std::move(owner);
+		storage.clear();
+		storage.shrink_to_fit();
+		this->data = data;
+		this->maxAbs.assign(maxAbs, maxAbs + numPartials);
+		this->maxAbsSlope.assign(maxAbsSlope, maxAbsSlope + numPartials);
+		this->numPartials = numPartials;
+		this->length = length;
+		this->loopEnd = loopEnd;
+		this->loopLength = loopLength;
+	}
+
+	const float* getPartial(int p) const { return data + (size_t)p * length; }
+
+	/** A partial's value at a fractional frame cursor. */
+	float interpolate(int p, double position) const
+	{
+		const int frame = (int)position;
+		const float* row = getPartial(p) + frame;
+		return row[0] + (row[1] - row[0]) * (float)(position - frame);
+	}
+
+	/** Frames per partial, including the guard frame. */
+	int getLength() const { return length; }
+	int getLoopLength() const { return loopLength; }
+	int getLoopEnd() const { return loopEnd; }
+	int getNumPartials() const { return numPartials; }
+
+	/** A cursor at or beyond this position must move back by getLoopLength(). */
+	int getWrapPosition() const { return loopLength > 0 ? loopEnd + loopLength : length - 1; }
+
+	/** Brings a cursor that has passed getWrapPosition() back into the table. */
+	double wrap(double position) const
+	{
+		if (position < getWrapPosition()) {
+			return position;
+		}
+		return loopLength > 0 ? position - loopLength : length - 2;
+	}
+
+	/**
+	 * Frees the frames but keeps the geometry and bounds, for a table whose
+	 * frames have been copied elsewhere (see FrameTable) and that is now only
+	 * needed for wrap() and the bounds. getPartial() and interpolate() must
+	 * not be called afterwards.
+	 */
+	void releaseData()
+	{
+		owner.reset();
+		storage.clear();
+		storage.shrink_to_fit();
+		data = nullptr;
+	}
+
+	bool isEmpty() const { return length == 0 || numPartials == 0; }
+
+	/** Whether the frames are still there, see releaseData(). */
+	bool hasData() const { return data != nullptr; }
+
+	/** The table, unless released, and its bounds, whether owned or viewed. */
+	size_t getBytes() const
+	{
+		const size_t frames = hasData() ? (size_t)numPartials * length : 0;
+		return (frames + maxAbs.size() + maxAbsSlope.size()) * sizeof(float);
+	}
+
+	/** The largest |value| of a partial, and the largest change between two of its frames. */
+	float getMaxAbs(int p) const { return maxAbs[p]; }
+	float getMaxAbsSlope(int p) const { return maxAbsSlope[p]; }
+
+private:
+	void computeBounds()
+	{
+		maxAbs.assign(numPartials, 0.0f);
+		maxAbsSlope.assign(numPartials, 0.0f);
+		for (int p = 0; p < numPartials; p++) {
+			const float* row = getPartial(p);
+			for (int i = 0; i < length; i++) {
+				maxAbs[p] = std::max(maxAbs[p], std::abs(row[i]));
+				if (i > 0) {
+					maxAbsSlope[p] = std::max(maxAbsSlope[p], std::abs(row[i] - row[i - 1]));
+				}
+			}
+		}
+	}
+
+	std::vector<float> storage;
+	std::shared_ptr<const void> owner;
+	const float* data = nullptr;
+	std::vector<float> maxAbs, maxAbsSlope;
+	int numPartials = 0;
+	int length = 0;
+	int loopEnd = 0;
+	int loopLength = 0;
+};
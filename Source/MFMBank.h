@@ -0,0 +1,835 @@
+/*
+  ==============================================================================
+
+    MFMBank.h
+    Created: 17 Oct 2026 12:31:08am
+    Author:  a931e
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <limits>
+#include <tuple>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+#include "MFMParam.h"
+#include "NoiseBank.h"
+
+/*
+ * A complete, immutable set of note tables: the MFMParams by MIDI note and
+ * everything derived from them that the voices need. Banks are built off the
+ * audio thread and handed to it whole through a BankPublisher; nothing in a
+ * published bank changes until it is freed.
+ *
+ * Since MFMParams never change once built, banks share them: with the bank
+ * they were built from, and with every other bank of the process (i.e. other
+ * plugin instances) that loads the same file, see getSharedParam().
+ */
+class MFMBank
+{
+public:
+	using ParamMap = std::map<int, std::shared_ptr<MFMParam>>;
+
+	// a note file as last seen on disk; a changed stamp means it was rewritten
+	struct NoteFile
+	{
+		std::string path;
+		juce::int64 modified = 0;
+		juce::int64 size = 0;
+
+		bool operator==(const NoteFile& other) const { return path == other.path && modified == other.modified && size == other.size; }
+		bool operator!=(const NoteFile& other) const { return !(*this == other); }
+	};
+	using FileMap = std::map<int, NoteFile>;
+
+	// the FileMap key of a packed bank, which holds all notes in one file
+	static constexpr int packedBankKey = -1;
+
+	// optional file in a table directory choosing how the frame tables are
+	// stored, see FrameTable::Format::parse()
+	static constexpr const char* precisionFileName = "precision.txt";
+
+	// loop points of the sustained tables, in seconds of the source
+	static constexpr float loopStartSeconds = 0.4f, loopEndSeconds = 1.25f, overlapSeconds = 0.5f;
+
+	/**
+	 * What a note without a file plays: nothing, the nearest loaded note, or
+	 * a blend of the loaded notes around it (the nearest note outside them).
+	 * Voices always play at the pitch of the key, so a borrowed table only
+	 * lends its timbre.
+	 */
+	enum class FillMode { none, nearest, interpolate };
+
+	/** Where the memory of a bank, and of the voices playing it, goes. */
+	struct Footprint
+	{
+		// bytes per loaded note, and per array over all notes
+		std::map<int, size_t> notes;
+		std::map<juce::String, size_t> arrays;
+		// of the notes' bytes, those mapped from a packed bank rather than allocated,
+		// and those of notes blended for missing keys
+		size_t mapped = 0;
+		size_t filled = 0;
+		// the noise tables, possibly shared with other instances
+		size_t noise = 0;
+		// filled in by the processor: bytes per voice, and the budget (0 for none)
+		std::vector<size_t> voices;
+		size_t budget = 0;
+
+		size_t getNoteBytes() const
+		{
+			size_t bytes = 0;
+			for (const auto& note : notes) {
+				bytes += note.second;
+			}
+			return bytes;
+		}
+
+		size_t getTotal() const
+		{
+			size_t bytes = getNoteBytes() + noise;
+			for (size_t voice : voices) {
+				bytes += voice;
+			}
+			return bytes;
+		}
+
+		/** A multi-line report, largest items first within each section. */
+		juce::String describe() const
+		{
+			auto mb = [](size_t bytes) { return juce::String(bytes / (1024.0 * 1024.0), 2) + " MB"; };
+			size_t voiceBytes = 0;
+			for (size_t voice : voices) {
+				voiceBytes += voice;
+			}
+
+			juce::String text = "Total " + mb(getTotal()) + ": notes " + mb(getNoteBytes());
+			if (mapped > 0) {
+				text += " (" + mb(mapped) + " mapped)";
+			}
+			if (filled > 0) {
+				text += " (" + mb(filled) + " blended for missing notes)";
+			}
+			text += ", noise " + mb(noise) + ", voices " + mb(voiceBytes);
+			text += budget > 0 ? "\nBudget for notes: " + mb(budget) : juce::String("\nNo budget for notes");
+
+			std::vector<std::pair<size_t, juce::String>> sorted;
+			for (const auto& array : arrays) {
+				sorted.push_back({ array.second, array.first });
+			}
+			std::sort(sorted.rbegin(), sorted.rend());
+			text += "\n\nPer array:";
+			for (const auto& array : sorted) {
+				text += "\n  " + array.second + ": " + mb(array.first);
+			}
+
+			text += "\n\nPer note (" + juce::String((int)notes.size()) + " loaded):";
+			for (const auto& note : notes) {
+				text += "\n  " + juce::String(note.first) + ": " + mb(note.second);
+			}
+
+			text += "\n\nPer voice (" + juce::String((int)voices.size()) + "):";
+			for (size_t i = 0; i < voices.size(); i++) {
+				text += "\n  " + juce::String((int)i + 1) + ": " + juce::String(voices[i] / 1024.0, 1) + " KB";
+			}
+			return text;
+		}
+	};
+
+	/** With FillMode::interpolate, blends the missing notes; call off the audio thread. */
+	MFMBank(ParamMap params, FileMap files, juce::String directory, double sampleRate, FillMode fillMode = FillMode::none)
+		: params(std::move(params)), files(std::move(files)), directory(directory), fillMode(fillMode)
+	{
+		if (fillMode == FillMode::interpolate) {
+			fillGaps();
+		}
+		// blended notes take memory and play their own noise like loaded ones
+		std::vector<float> cutoffs;
+		for (const auto* notes : { &this->params, &filled }) {
+			for (const auto& entry : *notes) {
+				maxNumPartials = std::max(maxNumPartials, entry.second->num_partials);
+				residentBytes += entry.second->getBytes();
+				cutoffs.push_back(entry.second->coloredCutoff1);
+				cutoffs.push_back(entry.second->coloredCutoff2);
+			}
+		}
+		noise = NoiseBank::create(sampleRate, cutoffs);
+	}
+
+	/** The same tables with the noise generated for another sample rate. */
+	std::shared_ptr<MFMBank> withSampleRate(double sampleRate) const
+	{
+		return std::make_shared<MFMBank>(params, files, directory, sampleRate, fillMode);
+	}
+
+	/** The same tables, filling missing notes as `mode` says. */
+	std::shared_ptr<MFMBank> withFillMode(FillMode mode) const
+	{
+		return std::make_shared<MFMBank>(params, files, directory, getSampleRate(), mode);
+	}
+
+	FillMode getFillMode() const { return fillMode; }
+
+	/** The table for a note, nullptr if the bank has none. Does not allocate. */
+	const MFMParam* find(int midiNoteNumber) const
+	{
+		auto it = params.find(midiNoteNumber);
+		return it != params.end() ? it->second.get() : nullptr;
+	}
+
+	/**
+	 * The table for a note or, if the note has a file that is not loaded
+	 * (yet), the table of the nearest loaded note. Without a file, the note
+	 * is filled as getFillMode() says. nullptr if that leaves nothing to
+	 * play. `sourceNote`, if given, is set to the note whose table it is
+	 * (midiNoteNumber itself for a filled note). Does not allocate.
+	 */
+	const MFMParam* findOrNearest(int midiNoteNumber, int* sourceNote = nullptr) const
+	{
+		if (sourceNote != nullptr) {
+			*sourceNote = midiNoteNumber;
+		}
+		auto it = params.lower_bound(midiNoteNumber);
+		if (it != params.end() && it->first == midiNoteNumber) {
+			return it->second.get();
+		}
+		auto blended = filled.find(midiNoteNumber);
+		if (blended != filled.end()) {
+			return blended->second.get();
+		}
+		if ((fillMode == FillMode::none && files.count(midiNoteNumber) == 0) || params.empty()) {
+			return nullptr;
+		}
+		if (it == params.end() || (it != params.begin() && midiNoteNumber - std::prev(it)->first <= it->first - midiNoteNumber)) {
+			--it;
+		}
+		if (sourceNote != nullptr) {
+			*sourceNote = it->first;
+		}
+		return it->second.get();
+	}
+
+	/** Whether the note's table is loaded, rather than only listed. */
+	bool isResident(int midiNoteNumber) const { return params.count(midiNoteNumber) != 0; }
+
+	const ParamMap& getParams() const { return params; }
+	const FileMap& getFiles() const { return files; }
+	const NoiseBank& getNoise() const { return *noise; }
+	double getSampleRate() const { return noise->getSampleRate(); }
+	int getMaxNumPartials() const { return maxNumPartials; }
+
+	/** The bytes of the loaded notes' arrays and of the notes blended for missing ones. */
+	size_t getResidentBytes() const { return residentBytes; }
+
+	/** The notes and noise of the bank; message or loader thread. */
+	Footprint getFootprint() const
+	{
+		Footprint footprint;
+		for (const auto& entry : params) {
+			for (const auto& array : entry.second->getArrayBytes()) {
+				footprint.notes[entry.first] += array.bytes;
+				footprint.arrays[array.name] += array.bytes;
+			}
+			if (entry.second->isMapped()) {
+				// a frame table is built at load, on the heap
+				footprint.mapped += entry.second->getBytes() - entry.second->frameTable.getBytes();
+			}
+		}
+		for (const auto& entry : filled) {
+			for (const auto& array : entry.second->getArrayBytes()) {
+				footprint.notes[entry.first] += array.bytes;
+				footprint.arrays[array.name] += array.bytes;
+			}
+			footprint.filled += entry.second->getBytes();
+		}
+		footprint.noise = noise->getBytes();
+		return footprint;
+	}
+	const juce::String& getDirectory() const { return directory; }
+
+	/** Set when the bank is published; later banks have higher generations. */
+	juce::uint64 getGeneration() const { return generation; }
+
+	/**
+	 * Lists the <midiNote>.npz files of `directory` with their stamps, or, if
+	 * `directory` is a .mfmbank file, that file under packedBankKey. Throws
+	 * if the directory cannot be listed.
+	 */
+	static FileMap scan(const juce::String& directory)
+	{
+		FileMap result;
+		const std::filesystem::path location(directory.toStdString());
+		if (location.extension() == ".mfmbank") {
+			NoteFile file;
+			file.path = location.string();
+			file.modified = (juce::int64)std::filesystem::last_write_time(location).time_since_epoch().count();
+			file.size = (juce::int64)std::filesystem::file_size(location);
+			result[packedBankKey] = file;
+			return result;
+		}
+		for (const auto& entry : std::filesystem::directory_iterator(directory.toStdString())) {
+			const auto& path = entry.path();
+			const auto stem = path.stem().string();
+			if (path.extension() != ".npz" || stem.empty() || stem.find_first_not_of("0123456789") != std::string::npos) {
+				continue;
+			}
+			std::error_code error;
+			NoteFile file;
+			file.path = path.string();
+			file.modified = (juce::int64)entry.last_write_time(error).time_since_epoch().count();
+			file.size = (juce::int64)entry.file_size(error);
+			result[std::stoi(stem)] = file;
+		}
+		return result;
+	}
+
+	/**
+	 * Builds a bank from the scanned `files`. Notes whose file is unchanged
+	 * since `previous` was built share its MFMParam; only the others are
+	 * decoded. Files that fail to load are skipped and described in `errors`;
+	 * `progress` is called after each file decoded with the share done, and
+	 * building stops early, returning nullptr, once `shouldExit` returns
+	 * true.
+	 *
+	 * With `notesToLoad`, only those notes are decoded, if they are not
+	 * shared; the others are listed in the bank but not resident, see
+	 * findOrNearest(). Without, every listed note is, except those in
+	 * `failures` that failed to decode before from the very same file.
+	 * A packed bank is always mapped whole, since it is paged in on demand.
+	 */
+	static std::shared_ptr<MFMBank> build(const juce::String& directory, const FileMap& files, double sampleRate, const MFMBank* previous,
+		juce::StringArray& errors, const std::function<void(float)>& progress, const std::function<bool()>& shouldExit,
+		const std::set<int>* notesToLoad = nullptr, const FileMap* failures = nullptr)
+	{
+		auto packed = files.find(packedBankKey);
+		if (packed != files.end()) {
+			return buildPacked(directory, files, sampleRate, previous, errors, progress);
+		}
+
+		const auto format = readFormat(directory, errors);
+		ParamMap params;
+		std::vector<FileMap::const_iterator> changed;
+		for (auto it = files.begin(); it != files.end(); ++it) {
+			if (previous != nullptr) {
+				auto old = previous->files.find(it->first);
+				auto oldParam = previous->params.find(it->first);
+				// unless the bank now asks for another precision
+				if (old != previous->files.end() && old->second == it->second
+					&& oldParam != previous->params.end() && oldParam->second->getFormat() == format) {
+					params[it->first] = oldParam->second;
+					continue;
+				}
+			}
+			if (notesToLoad == nullptr && failures != nullptr) {
+				// failed before; only retried once the file changes or when asked for by note
+				auto failure = failures->find(it->first);
+				if (failure != failures->end() && failure->second == it->second) {
+					continue;
+				}
+			}
+			if (notesToLoad == nullptr || notesToLoad->count(it->first) != 0) {
+				changed.push_back(it);
+			}
+		}
+
+		for (size_t i = 0; i < changed.size(); i++) {
+			if (shouldExit()) {
+				return nullptr;
+			}
+			try {
+				const auto& file = changed[i]->second;
+				params[changed[i]->first] = getSharedParam(file, changed[i]->first, format, [&file, &format] {
+					auto param = std::make_shared<MFMParam>(file.path);
+
+					// for now loop start, end and overlap are hardcoded
+					param->buildLoopTables(loopStartSeconds, loopEndSeconds, overlapSeconds);
+					param->applyFormat(format);
+					// the voices and blends only read the tables
+					param->releaseSources();
+					return param;
+				});
+			}
+			catch (std::exception& e) {
+				errors.add(juce::String(std::filesystem::path(changed[i]->second.path).filename().string()) + ": " + e.what());
+			}
+			progress((float)(i + 1) / changed.size());
+		}
+		return std::make_shared<MFMBank>(std::move(params), files, directory, sampleRate);
+	}
+
+	/**
+	 * The frame table format `directory` asks for in its precision file,
+	 * frame-major float32 throughout if it has none; a file that does not
+	 * parse is described in `errors` and ignored. Not read for packed banks,
+	 * which carry the format they were compiled for.
+	 */
+	static FrameTable::Format readFormat(const juce::String& directory, juce::StringArray& errors)
+	{
+		FrameTable::Format format;
+		const auto file = juce::File(directory).getChildFile(precisionFileName);
+		juce::String error;
+		if (file.existsAsFile() && !FrameTable::Format::parse(file.loadFileAsString(), format, error)) {
+			errors.add(juce::String(precisionFileName) + ": " + error);
+			format = {};
+		}
+		return format;
+	}
+
+	/** Reads every <midiNote>.npz in `directory`, see build(). */
+	static std::shared_ptr<MFMBank> load(const juce::String& directory, double sampleRate, juce::StringArray& errors,
+		const std::function<void(float)>& progress, const std::function<bool()>& shouldExit)
+	{
+		return build(directory, scan(directory), sampleRate, nullptr, errors, progress, shouldExit);
+	}
+
+	/**
+	 * Writes `params` as a packed bank, see PackedBank, to be opened with
+	 * the tables stored as `format` says. The file is written next to `file`
+	 * and renamed over it, so a bank mapped from `file` stays intact. The
+	 * notes must still have their decoded arrays and partial-major loop
+	 * tables, as the ones BankCompiler decodes do; banks built by build()
+	 * release them. Returns false and sets `error` on failure.
+	 */
+	static bool writePacked(const ParamMap& params, const juce::File& file, const FrameTable::Format& format, juce::String& error)
+	{
+		const juce::File temp = file.getSiblingFile(file.getFileName() + ".tmp");
+		temp.deleteFile();
+		{
+			juce::FileOutputStream out(temp);
+			if (!out.openedOk()) {
+				error = "unable to write " + temp.getFullPathName();
+				return false;
+			}
+
+			PackedBank::FileHeader header{};
+			std::memcpy(header.magic, PackedBank::magic, sizeof(header.magic));
+			header.version = PackedBank::version;
+			header.numNotes = (uint32_t)params.size();
+			header.loopStartSeconds = loopStartSeconds;
+			header.loopEndSeconds = loopEndSeconds;
+			header.overlapSeconds = overlapSeconds;
+			if (!PackedBank::setFormat(header, format)) {
+				error = "a packed bank cannot store the two alphaLocal envelopes in different encodings";
+				return false;
+			}
+			out.write(&header, sizeof(header));
+
+			auto padTo = [&out](uint64_t offset) {
+				static const char zeros[PackedBank::alignment] = {};
+				while ((uint64_t)out.getPosition() < offset) {
+					out.write(zeros, (size_t)std::min<uint64_t>(offset - out.getPosition(), sizeof(zeros)));
+				}
+			};
+			// `rows` rows of `rowLength` floats, `stride` apart in memory
+			auto writeArray = [&](PackedBank::ArrayRef& ref, const float* data, size_t rows, size_t rowLength, size_t stride) {
+				padTo(PackedBank::align((uint64_t)out.getPosition()));
+				ref.offset = (uint64_t)out.getPosition();
+				ref.count = rows * rowLength;
+				for (size_t r = 0; r < rows; r++) {
+					out.write(data + r * stride, rowLength * sizeof(float));
+				}
+			};
+			auto writeParamArray = [&](PackedBank::ArrayRef& ref, const ParamArray& array) {
+				writeArray(ref, array.get(), 1, array.getSize(), 0);
+			};
+			auto writeLoop = [&](PackedBank::LoopRef& ref, const LoopTable& table) {
+				std::vector<float> maxAbs, maxAbsSlope;
+				for (int p = 0; p < table.getNumPartials(); p++) {
+					maxAbs.push_back(table.getMaxAbs(p));
+					maxAbsSlope.push_back(table.getMaxAbsSlope(p));
+				}
+				writeArray(ref.data, table.getPartial(0), 1, (size_t)table.getNumPartials() * table.getLength(), 0);
+				writeArray(ref.maxAbs, maxAbs.data(), 1, maxAbs.size(), 0);
+				writeArray(ref.maxAbsSlope, maxAbsSlope.data(), 1, maxAbsSlope.size(), 0);
+				ref.length = table.getLength();
+				ref.loopEnd = table.getLoopEnd();
+				ref.loopLength = table.getLoopLength();
+				ref.reserved = 0;
+			};
+
+			std::vector<PackedBank::NoteRecord> records;
+			for (const auto& entry : params) {
+				const MFMParam& param = *entry.second;
+				if (!param.magGlobalLoop.hasData() || !param.alphaGlobalLoop.hasData()
+					|| !param.alphaLocalEnv1Loop.hasData() || !param.alphaLocalEnv2Loop.hasData()) {
+					error = "note " + juce::String(entry.first) + " has no partial-major loop tables";
+					return false;
+				}
+				if (!param.hasSources()) {
+					error = "note " + juce::String(entry.first) + " has released its decoded arrays";
+					return false;
+				}
+				PackedBank::NoteRecord note{};
+				note.midiNote = entry.first;
+				note.numPartials = param.num_partials;
+				note.numSamples = param.num_samples;
+				note.paramSr = param.param_sr;
+				note.attackLen = param.attackLen;
+				note.sampleRate = param.sampleRate;
+				note.baseFreq = param.base_freq;
+				note.coloredCutoff1 = param.coloredCutoff1;
+				note.coloredCutoff2 = param.coloredCutoff2;
+
+				writeParamArray(note.magGlobal, param.magGlobal);
+				writeParamArray(note.attackWave, param.attackWave);
+				writeParamArray(note.alphaGlobal, param.alphaGlobal);
+				writeParamArray(note.envelope, param.envelope);
+				writeParamArray(note.spreadingCenter, param.alphaLocalSpreadingCenter);
+				writeParamArray(note.spreadingFactor, param.alphaLocalSpreadingFactor);
+				writeParamArray(note.noiseGain, param.alphaLocalNoiseGain);
+				writeParamArray(note.gain, param.alphaLocalGain);
+				writeArray(note.env1, param.alphaLocalEnv1.get(), param.num_partials, param.num_samples, param.alphaLocalEnvStride);
+				writeArray(note.env2, param.alphaLocalEnv2.get(), param.num_partials, param.num_samples, param.alphaLocalEnvStride);
+
+				writeLoop(note.magGlobalLoop, param.magGlobalLoop);
+				writeLoop(note.alphaGlobalLoop, param.alphaGlobalLoop);
+				writeLoop(note.env1Loop, param.alphaLocalEnv1Loop);
+				writeLoop(note.env2Loop, param.alphaLocalEnv2Loop);
+				records.push_back(note);
+			}
+
+			padTo(PackedBank::align((uint64_t)out.getPosition()));
+			header.indexOffset = (uint64_t)out.getPosition();
+			out.write(records.data(), records.size() * sizeof(PackedBank::NoteRecord));
+			header.fileSize = (uint64_t)out.getPosition();
+			out.setPosition(0);
+			out.write(&header, sizeof(header));
+			out.flush();
+			if (out.getStatus().failed()) {
+				error = out.getStatus().getErrorMessage();
+				return false;
+			}
+		}
+		if (!temp.moveFileTo(file)) {
+			error = "unable to replace " + file.getFullPathName();
+			return false;
+		}
+		return true;
+	}
+
+private:
+	friend class BankPublisher;
+
+	// all notes of a packed bank, viewed in its mapping, with their tables
+	// stored as the bank's format says (see PackedBank)
+	static std::shared_ptr<MFMBank> buildPacked(const juce::String& directory, const FileMap& files, double sampleRate, const MFMBank* previous,
+		juce::StringArray& errors, const std::function<void(float)>& progress)
+	{
+		if (previous != nullptr && previous->files == files) {
+			return std::make_shared<MFMBank>(previous->params, files, directory, sampleRate);
+		}
+
+		juce::String error;
+		auto pack = PackedBank::open(juce::File(files.at(packedBankKey).path), error);
+		if (pack == nullptr) {
+			errors.add(error);
+			return nullptr;
+		}
+
+		ParamMap params;
+		const auto& file = files.at(packedBankKey);
+		const auto format = pack->getFormat();
+		for (int i = 0; i < pack->getNumNotes(); i++) {
+			const int note = pack->getNote(i).midiNote;
+			params[note] = getSharedParam(file, note, format, [&pack, &format, i] {
+				auto param = std::make_shared<MFMParam>(pack, i);
+				param->applyFormat(format);
+				return param;
+			});
+		}
+		progress(1);
+		return std::make_shared<MFMBank>(std::move(params), files, directory, sampleRate);
+	}
+
+	/**
+	 * The note `midiNote` of `file`, shared by every bank of the process
+	 * that loads the same file as it is on disk now: the first bank to ask
+	 * calls `load`, banks asking meanwhile wait for its result, and later
+	 * ones get the same MFMParam for as long as any bank holds it. Files are
+	 * told apart by canonical path, modification time and size, and loads
+	 * for different frame table formats apart. Rethrows what `load` throws.
+	 */
+	static std::shared_ptr<MFMParam> getSharedParam(const NoteFile& file, int midiNote, const FrameTable::Format& format,
+		const std::function<std::shared_ptr<MFMParam>()>& load)
+	{
+		using Key = std::tuple<std::string, juce::int64, juce::int64, int, std::string>;
+		struct Entry
+		{
+			std::weak_ptr<MFMParam> param;
+			std::shared_future<std::shared_ptr<MFMParam>> pending;
+		};
+		static std::mutex lock;
+		static std::map<Key, Entry> registry;
+
+		std::error_code error;
+		const auto canonical = std::filesystem::weakly_canonical(file.path, error);
+		const Key key{ error ? file.path : canonical.string(), file.modified, file.size, midiNote, format.toString().toStdString() };
+
+		std::promise<std::shared_ptr<MFMParam>> promise;
+		std::shared_future<std::shared_ptr<MFMParam>> pending;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			auto& entry = registry[key];
+			if (auto param = entry.param.lock()) {
+				return param;
+			}
+			if (entry.pending.valid()) {
+				pending = entry.pending;
+			}
+			else {
+				entry.pending = promise.get_future().share();
+			}
+		}
+		if (pending.valid()) {
+			// another bank is loading it
+			return pending.get();
+		}
+
+		std::shared_ptr<MFMParam> param;
+		try {
+			param = load();
+		}
+		catch (...) {
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				registry[key].pending = {};
+			}
+			promise.set_exception(std::current_exception());
+			throw;
+		}
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			// forget the files no bank holds anymore
+			for (auto it = registry.begin(); it != registry.end();) {
+				const bool unused = it->second.param.expired() && !it->second.pending.valid() && it->first != key;
+				it = unused ? registry.erase(it) : std::next(it);
+			}
+			auto& entry = registry[key];
+			entry.param = param;
+			entry.pending = {};
+		}
+		promise.set_value(param);
+		return param;
+	}
+
+	/**
+	 * Blends every note without a file between two loaded notes, if they
+	 * can be blended (MFMParam::canBlend()). Blends are shared by all banks of the
+	 * process with the same two notes, so rebuilding a bank reuses them.
+	 */
+	void fillGaps()
+	{
+		for (auto upper = params.begin(); upper != params.end(); ++upper) {
+			if (upper == params.begin()) {
+				continue;
+			}
+			auto lower = std::prev(upper);
+			if (!MFMParam::canBlend(*lower->second, *upper->second)) {
+				continue;
+			}
+			for (int note = lower->first + 1; note < upper->first; note++) {
+				if (files.count(note) == 0) {
+					filled[note] = getSharedBlend(lower->second, upper->second, (float)(note - lower->first) / (upper->first - lower->first));
+				}
+			}
+		}
+	}
+
+	static std::shared_ptr<MFMParam> getSharedBlend(const std::shared_ptr<MFMParam>& lower, const std::shared_ptr<MFMParam>& upper, float weight)
+	{
+		struct Entry
+		{
+			std::weak_ptr<MFMParam> lower, upper, blend;
+			float weight;
+		};
+		static std::mutex lock;
+		static std::vector<Entry> cache;
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			for (const auto& entry : cache) {
+				if (entry.weight == weight && entry.lower.lock() == lower && entry.upper.lock() == upper) {
+					if (auto blend = entry.blend.lock()) {
+						return blend;
+					}
+				}
+			}
+		}
+
+		auto blend = std::make_shared<MFMParam>(*lower, *upper, weight);
+		// in the layout of the notes it is blended from, as a bank's notes all are
+		blend->applyFormat(lower->getFormat());
+
+		std::lock_guard<std::mutex> guard(lock);
+		cache.erase(std::remove_if(cache.begin(), cache.end(), [](const Entry& entry) { return entry.blend.expired(); }), cache.end());
+		cache.push_back({ lower, upper, blend, weight });
+		return blend;
+	}
+
+	ParamMap params;
+	// notes without a file, blended from the loaded notes around them
+	ParamMap filled;
+	FileMap files;
+	std::shared_ptr<const NoiseBank> noise;
+	juce::String directory;
+	FillMode fillMode = FillMode::none;
+	int maxNumPartials = 1;
+	size_t residentBytes = 0;
+	juce::uint64 generation = 0;
+};
+
+/*
+ * Hands banks from the message thread to the audio thread without locks:
+ * publish() swaps an atomic pointer that the audio thread reads with
+ * acquire() at the start of each block.
+ *
+ * The audio thread never frees a bank. A replaced bank is retired and freed
+ * by reclaim(), usually on a BankReclaimer, once no note still sounding uses
+ * its generation, as the audio thread reports through endBlock(), and no
+ * block can still be reading it: either a whole block has started after the
+ * swap, or no block is in progress, since the next one acquires the new
+ * bank. So banks are also freed while the host does not call the audio
+ * callback at all (transport stopped, plugin suspended or bypassed).
+ */
+class BankPublisher
+{
+public:
+	//==============================================================================
+	// message thread
+
+	void publish(std::shared_ptr<MFMBank> bank)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (bank != nullptr) {
+			bank->generation = ++lastGeneration;
+		}
+		if (current != nullptr) {
+			retired.push_back({ current, blocksCompleted.load(std::memory_order_acquire) });
+		}
+		current = std::move(bank);
+		live.store(current.get(), std::memory_order_seq_cst);
+	}
+
+	std::shared_ptr<const MFMBank> getCurrent() const
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		return current;
+	}
+
+	/** Frees the retired banks the audio thread is done with. */
+	void reclaim()
+	{
+		std::vector<std::shared_ptr<const MFMBank>> released;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			// started before completed: if they match, no block ran in
+			// between, and any block starting later acquires the current bank
+			const juce::uint64 started = blocksStarted.load(std::memory_order_seq_cst);
+			const juce::uint64 blocks = blocksCompleted.load(std::memory_order_seq_cst);
+			// the oldest generation was stored before the block count
+			const juce::uint64 oldest = oldestInUse.load(std::memory_order_relaxed);
+			const bool idle = started == blocks;
+			for (auto it = retired.begin(); it != retired.end();) {
+				if ((idle || blocks >= it->retiredAtBlock + 2) && it->bank->getGeneration() < oldest) {
+					released.push_back(std::move(it->bank));
+					it = retired.erase(it);
+				}
+				else {
+					++it;
+				}
+			}
+		}
+		// the banks are freed here, outside the lock
+	}
+
+	//==============================================================================
+	// audio thread
+
+	/** The bank new notes of this block come from; call once at the start of each block. */
+	const MFMBank* acquire()
+	{
+		blocksStarted.fetch_add(1, std::memory_order_seq_cst);
+		return live.load(std::memory_order_seq_cst);
+	}
+
+	/**
+	 * Reports the oldest generation a note still sounding plays from at the
+	 * end of a block, or noneInUse; the acquired bank need not be counted.
+	 */
+	void endBlock(juce::uint64 oldestGenerationInUse)
+	{
+		oldestInUse.store(oldestGenerationInUse, std::memory_order_relaxed);
+		blocksCompleted.fetch_add(1, std::memory_order_seq_cst);
+	}
+
+	/**
+	 * Reports that no note is sounding any more, with no block in progress,
+	 * e.g. once the voices are silenced when playback stops.
+	 */
+	void endPlayback()
+	{
+		oldestInUse.store(noneInUse, std::memory_order_seq_cst);
+	}
+
+	static constexpr juce::uint64 noneInUse = std::numeric_limits<juce::uint64>::max();
+
+private:
+	struct Retired
+	{
+		std::shared_ptr<const MFMBank> bank;
+		juce::uint64 retiredAtBlock;
+	};
+
+	mutable std::mutex lock;
+	std::shared_ptr<const MFMBank> current;
+	std::vector<Retired> retired;
+	juce::uint64 lastGeneration = 0;
+
+	std::atomic<const MFMBank*> live{ nullptr };
+	std::atomic<juce::uint64> oldestInUse{ noneInUse };
+	std::atomic<juce::uint64> blocksStarted{ 0 };
+	std::atomic<juce::uint64> blocksCompleted{ 0 };
+};
+
+/*
+ * Frees retired banks in the background, so that releasing a bank's tables
+ * costs neither the audio thread nor the message thread anything.
+ */
+class BankReclaimer : private juce::Thread
+{
+public:
+	explicit BankReclaimer(BankPublisher& publisher)
+		: juce::Thread("MFM bank reclaimer"), publisher(publisher)
+	{
+		startThread();
+	}
+
+	~BankReclaimer() override
+	{
+		stopThread(1000);
+	}
+
+private:
+	static constexpr int reclaimIntervalMs = 250;
+
+	void run() override
+	{
+		while (!threadShouldExit()) {
+			wait(reclaimIntervalMs);
+			publisher.reclaim();
+		}
+	}
+
+	BankPublisher& publisher;
+};
@@ -11,71 +11,412 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include <cmath>
 #include <memory>
+#include <stdexcept>
 #include <vector>
 #include "cnpy/cnpy.h"
+#include "LoopTable.h"
+#include "FrameTable.h"
+#include "PackedBank.h"
 
 
+/*
+ * A float array decoded by cnpy, or mapped from a packed bank, adopted without
+ * copying. Several arrays can view the same buffer, which stays alive as long
+ * as any of them.
+ */
+class ParamArray
+{
+public:
+	ParamArray() {}
+
+	/** Views `array` from element `offset` on. */
+	explicit ParamArray(const cnpy::NpyArray& array, size_t offset = 0)
+		: holder(array.data_holder), data(array.data<float>() + offset), size(array.num_vals - offset)
+	{
+		jassert(array.word_size == sizeof(float) && offset <= array.num_vals);
+	}
+
+	/** Views `size` floats at `data`, which `owner` keeps alive. */
+	ParamArray(std::shared_ptr<const void> owner, const float* data, size_t size)
+		: holder(std::move(owner)), data(data), size(size)
+	{
+	}
+
+	const float& operator[](size_t i) const
+	{
+		jassert(i < size);
+		return data[i];
+	}
+
+	const float* get() const { return data; }
+	size_t getSize() const { return size; }
+	size_t getBytes() const { return size * sizeof(float); }
+
+private:
+	std::shared_ptr<const void> holder;
+	const float* data = nullptr;
+	size_t size = 0;
+};
 
 class MFMParam
 {
 public:
-	std::unique_ptr<float[]> magGlobal, attackWave, alphaGlobal, envelope;
-    std::unique_ptr<float[]> alphaLocalSpreadingCenter, alphaLocalSpreadingFactor, alphaLocalNoiseGain, alphaLocalEnv, alphaLocalEnv1, alphaLocalEnv2, alphaLocalGain;
+	ParamArray magGlobal, attackWave, alphaGlobal, envelope;
+    ParamArray alphaLocalSpreadingCenter, alphaLocalSpreadingFactor, alphaLocalNoiseGain, alphaLocalEnv, alphaLocalGain;
+	// the two envelopes interleaved in alphaLocalEnv; a partial's rows are
+	// alphaLocalEnvStride apart
+	ParamArray alphaLocalEnv1, alphaLocalEnv2;
+	int alphaLocalEnvStride;
     int param_sr, num_samples, num_partials, overlapLen, attackLen, sampleRate;
 	float base_freq, coloredCutoff1, coloredCutoff2;
 
+	// looped copies of the tables the voices read while sustaining, see buildLoopTables()
+	LoopTable magGlobalLoop, alphaGlobalLoop, alphaLocalEnv1Loop, alphaLocalEnv2Loop;
+	// the same four tables frame-major, if built; see applyFormat()
+	FrameTable frameTable;
+
+	struct ArrayBytes
+	{
+		const char* name;
+		size_t bytes;
+	};
 
+
+	/**
+	 * Decodes a note file. Throws std::runtime_error if an array is missing,
+	 * is not float32 or does not have the shape implied by magRatio, or if
+	 * the scalars do not fit the arrays, see validate().
+	 */
 	MFMParam(std::string path)
     {
-		cnpy::NpyArray magGlobalArray = cnpy::read_npz(path, "magRatio");
+		// one pass over the archive; only the arrays below are decoded
+		cnpy::NpzArchive archive(path);
+
+		cnpy::NpyArray magGlobalArray = archive.load("magRatio");
+		expectShape(magGlobalArray, "magRatio", { 0, 0 });
         num_samples = magGlobalArray.shape[1];
         num_partials = magGlobalArray.shape[0];
+		if (num_samples == 0 || num_partials == 0) {
+			throw std::runtime_error("MFMParam: magRatio is empty");
+		}
+		const size_t partials = num_partials, samples = num_samples;
 
 
-        param_sr = cnpy::read_npz(path, "par_sr").as_vec<int>()[0];
-		attackLen = cnpy::read_npz(path, "attackLen").as_vec<int>()[0];
-        overlapLen = cnpy::read_npz(path, "overlapLen").as_vec<int>()[0];
+        param_sr = loadScalar<int>(archive, "par_sr");
+		attackLen = loadScalar<int>(archive, "attackLen");
         overlapLen = attackLen / 2;
-		sampleRate = cnpy::read_npz(path, "sampleRate").as_vec<int>()[0];
-		magGlobal = load_np_into_array(path, "magRatio");
-		attackWave = load_np_into_array(path, "attackWave");
-		alphaGlobal = load_np_into_array(path, "alphaGlobal");
-		envelope = load_np_into_array(path, "totalEnv");
-		base_freq = cnpy::read_npz(path, "pitch").as_vec<float>()[0];
-
-		alphaLocalSpreadingCenter = load_np_into_array(path, "alphaLocal.spreadingCenter");
-		alphaLocalSpreadingFactor = load_np_into_array(path, "alphaLocal.spreadingFactor");
-		alphaLocalNoiseGain = load_np_into_array(path, "alphaLocal.noiseGain");
-		alphaLocalEnv = load_np_into_array(path, "alphaLocal.env"); // num_partials, 2, num_samples
-		alphaLocalEnv1 = std::make_unique<float[]>(num_partials * num_samples);
-        alphaLocalEnv2 = std::make_unique<float[]>(num_partials * num_samples);
-
-		for (int p = 0; p < num_partials; p++) {
-			for (int s = 0; s < num_samples; s++) {
-				alphaLocalEnv1[p * num_samples + s] = alphaLocalEnv[p * 2 * num_samples + s];
-				alphaLocalEnv2[p * num_samples + s] = alphaLocalEnv[p * 2 * num_samples + s + num_samples];
-			}
-		}
+		sampleRate = loadScalar<int>(archive, "sampleRate");
+		magGlobal = ParamArray(magGlobalArray);
+		attackWave = load_np_into_array(archive, "attackWave", {});
+		alphaGlobal = load_np_into_array(archive, "alphaGlobal", { partials, samples });
+		envelope = load_np_into_array(archive, "totalEnv", {});
+		base_freq = loadScalar<float>(archive, "pitch");
+
+		alphaLocalSpreadingCenter = load_np_into_array(archive, "alphaLocal.spreadingCenter", { partials, 2 });
+		alphaLocalSpreadingFactor = load_np_into_array(archive, "alphaLocal.spreadingFactor", { partials, 2 });
+		alphaLocalNoiseGain = load_np_into_array(archive, "alphaLocal.noiseGain", { partials, 2 });
+		cnpy::NpyArray alphaLocalEnvArray = archive.load("alphaLocal.env"); // num_partials, 2, num_samples
+		expectShape(alphaLocalEnvArray, "alphaLocal.env", { partials, 2, samples });
+		alphaLocalEnv = ParamArray(alphaLocalEnvArray);
+		alphaLocalEnv1 = ParamArray(alphaLocalEnvArray, 0);
+		alphaLocalEnv2 = ParamArray(alphaLocalEnvArray, num_samples);
+		alphaLocalEnvStride = 2 * num_samples;
 
 
-        alphaLocalGain = load_np_into_array(path, "alphaLocal.gain");
+        alphaLocalGain = load_np_into_array(archive, "alphaLocal.gain", { partials });
        
-		coloredCutoff1 = cnpy::read_npz(path, "coloredCutoff1").as_vec<float>()[0];
-		coloredCutoff2 = cnpy::read_npz(path, "coloredCutoff2").as_vec<float>()[0];
+		coloredCutoff1 = loadScalar<float>(archive, "coloredCutoff1");
+		coloredCutoff2 = loadScalar<float>(archive, "coloredCutoff2");
+		validate();
     }
 
-    std::unique_ptr<float[]> load_np_into_array(std::string path, std::string key) {
-		auto npy_array = cnpy::read_npz(path, key);
-        auto npy_data = npy_array.data<float>();
-        auto array = new float[npy_array.num_vals];
-        for (int i = 0; i < npy_array.num_vals; i++) {
-            array[i] = npy_data[i];
-        }
-		return std::unique_ptr<float[]>(array);
+	/** Views the note at `index` of a packed bank, loop tables included. */
+	MFMParam(std::shared_ptr<const PackedBank> pack, int index)
+	{
+		const auto& note = pack->getNote(index);
+		num_partials = note.numPartials;
+		num_samples = note.numSamples;
+		param_sr = note.paramSr;
+		attackLen = note.attackLen;
+		overlapLen = attackLen / 2;
+		sampleRate = note.sampleRate;
+		base_freq = note.baseFreq;
+		coloredCutoff1 = note.coloredCutoff1;
+		coloredCutoff2 = note.coloredCutoff2;
+		mapped = true;
+
+		auto view = [&pack](const PackedBank::ArrayRef& array) {
+			return ParamArray(pack, pack->getFloats(array), (size_t)array.count);
+		};
+		magGlobal = view(note.magGlobal);
+		attackWave = view(note.attackWave);
+		alphaGlobal = view(note.alphaGlobal);
+		envelope = view(note.envelope);
+		alphaLocalSpreadingCenter = view(note.spreadingCenter);
+		alphaLocalSpreadingFactor = view(note.spreadingFactor);
+		alphaLocalNoiseGain = view(note.noiseGain);
+		alphaLocalGain = view(note.gain);
+		// stored split; alphaLocalEnv, the interleaved source, is not kept
+		alphaLocalEnv1 = view(note.env1);
+		alphaLocalEnv2 = view(note.env2);
+		alphaLocalEnvStride = num_samples;
+
+		auto viewLoop = [&pack, this](LoopTable& table, const PackedBank::LoopRef& loop) {
+			table.view(pack, pack->getFloats(loop.data), pack->getFloats(loop.maxAbs), pack->getFloats(loop.maxAbsSlope),
+				num_partials, loop.length, loop.loopEnd, loop.loopLength);
+		};
+		viewLoop(magGlobalLoop, note.magGlobalLoop);
+		viewLoop(alphaGlobalLoop, note.alphaGlobalLoop);
+		viewLoop(alphaLocalEnv1Loop, note.env1Loop);
+		viewLoop(alphaLocalEnv2Loop, note.env2Loop);
+	}
+
+	/**
+	 * A note between two others, for a bank that has no table for it: the
+	 * loop tables and per-partial values of `lower` and `upper` blended
+	 * with `weight` (0 is `lower`), over the partials both have. The loop
+	 * tables are read from the notes' frame tables where their frames moved
+	 * there, so neither note needs its decoded arrays; the blend has none.
+	 * The attack, which is a waveform, is taken whole from the nearer note.
+	 * The notes must pass canBlend().
+	 */
+	MFMParam(const MFMParam& lower, const MFMParam& upper, float weight)
+	{
+		jassert(canBlend(lower, upper));
+		const MFMParam& nearer = weight < 0.5f ? lower : upper;
+		num_partials = std::min(lower.num_partials, upper.num_partials);
+		num_samples = std::min(lower.num_samples, upper.num_samples);
+		param_sr = lower.param_sr;
+		attackLen = nearer.attackLen;
+		overlapLen = nearer.overlapLen;
+		sampleRate = nearer.sampleRate;
+		attackWave = nearer.attackWave;
+		envelope = nearer.envelope;
+		base_freq = lower.base_freq * std::pow(upper.base_freq / lower.base_freq, weight);
+		coloredCutoff1 = juce::jmap(weight, lower.coloredCutoff1, upper.coloredCutoff1);
+		coloredCutoff2 = juce::jmap(weight, lower.coloredCutoff2, upper.coloredCutoff2);
+
+		const size_t partials = num_partials;
+		// `rows` rows of `length` values, each source row `stride` apart
+		auto blend = [weight](const float* a, size_t strideA, const float* b, size_t strideB, size_t rows, size_t length, float* out, size_t strideOut) {
+			for (size_t r = 0; r < rows; r++) {
+				for (size_t i = 0; i < length; i++) {
+					out[r * strideOut + i] = a[r * strideA + i] + (b[r * strideB + i] - a[r * strideA + i]) * weight;
+				}
+			}
+		};
+		auto blendArray = [&](const ParamArray& a, const ParamArray& b, size_t rowsA, size_t rowsB, size_t rows, size_t length) {
+			auto values = std::make_shared<std::vector<float>>(rows * length);
+			blend(a.get(), a.getSize() / rowsA, b.get(), b.getSize() / rowsB, rows, length, values->data(), length);
+			return ParamArray(values, values->data(), values->size());
+		};
+		alphaLocalSpreadingCenter = blendArray(lower.alphaLocalSpreadingCenter, upper.alphaLocalSpreadingCenter, lower.num_partials, upper.num_partials, partials, 2);
+		alphaLocalSpreadingFactor = blendArray(lower.alphaLocalSpreadingFactor, upper.alphaLocalSpreadingFactor, lower.num_partials, upper.num_partials, partials, 2);
+		alphaLocalNoiseGain = blendArray(lower.alphaLocalNoiseGain, upper.alphaLocalNoiseGain, lower.num_partials, upper.num_partials, partials, 2);
+		alphaLocalGain = blendArray(lower.alphaLocalGain, upper.alphaLocalGain, lower.num_partials, upper.num_partials, partials, 1);
+
+		alphaLocalEnvStride = num_samples;
+		LoopTable* tables[FrameTable::numQuantities] = { &magGlobalLoop, &alphaGlobalLoop, &alphaLocalEnv1Loop, &alphaLocalEnv2Loop };
+		for (int q = 0; q < FrameTable::numQuantities; q++) {
+			const auto quantity = (FrameTable::Quantity)q;
+			tables[q]->build(lower.magGlobalLoop, num_partials, [&](int p, int frame) {
+				const float a = lower.getTableValue(quantity, p, frame);
+				return a + (upper.getTableValue(quantity, p, frame) - a) * weight;
+			});
+		}
+	}
+
+	/** Whether a note can be blended between the two: same parameter rate and loop geometry. */
+	static bool canBlend(const MFMParam& lower, const MFMParam& upper)
+	{
+		const LoopTable& a = lower.magGlobalLoop;
+		const LoopTable& b = upper.magGlobalLoop;
+		return lower.param_sr == upper.param_sr && !a.isEmpty() && !b.isEmpty()
+			&& a.getLength() == b.getLength() && a.getLoopEnd() == b.getLoopEnd() && a.getLoopLength() == b.getLoopLength();
+	}
+
+	/**
+	 * Drops the decoded arrays the loop tables were built from: magGlobal,
+	 * alphaGlobal and alphaLocal.env with its views. The voices and blends
+	 * only read the tables; a note without them can no longer be packed.
+	 */
+	void releaseSources()
+	{
+		magGlobal = ParamArray();
+		alphaGlobal = ParamArray();
+		alphaLocalEnv = ParamArray();
+		alphaLocalEnv1 = ParamArray();
+		alphaLocalEnv2 = ParamArray();
+	}
+
+	bool hasSources() const { return magGlobal.get() != nullptr; }
+
+	/** Frame `frame` of partial p of a loop table, from frameTable if the table's frames moved there. */
+	float getTableValue(FrameTable::Quantity quantity, int p, int frame) const
+	{
+		const LoopTable* tables[FrameTable::numQuantities] = { &magGlobalLoop, &alphaGlobalLoop, &alphaLocalEnv1Loop, &alphaLocalEnv2Loop };
+		return tables[quantity]->hasData() ? tables[quantity]->getPartial(p)[frame] : frameTable.getValue(frame, quantity, p);
+	}
+
+	/**
+	 * Precomputes the crossfaded loops of magGlobal, alphaGlobal and
+	 * alphaLocalEnv1/2 once, so voices only have to walk them.
+	 */
+	void buildLoopTables(float loopStartSeconds, float loopEndSeconds, float overlapSeconds)
+	{
+		const int loopStart = juce::roundToInt(loopStartSeconds * param_sr);
+		const int loopEnd = std::min(juce::roundToInt(loopEndSeconds * param_sr), num_samples);
+		const int overlap = juce::roundToInt(overlapSeconds * param_sr);
+
+		magGlobalLoop.build(magGlobal.get(), num_partials, num_samples, num_samples, loopStart, loopEnd, overlap);
+		alphaGlobalLoop.build(alphaGlobal.get(), num_partials, num_samples, num_samples, loopStart, loopEnd, overlap);
+		alphaLocalEnv1Loop.build(alphaLocalEnv1.get(), num_partials, num_samples, alphaLocalEnvStride, loopStart, loopEnd, overlap);
+		alphaLocalEnv2Loop.build(alphaLocalEnv2.get(), num_partials, num_samples, alphaLocalEnvStride, loopStart, loopEnd, overlap);
+	}
+
+	/**
+	 * Stores the loop tables as `format` says: with Layout::frameMajor their
+	 * frames move into frameTable, encoded as the format asks, where the
+	 * voices read a frame as one contiguous row; the loop tables keep their
+	 * geometry and bounds. With Layout::partialMajor they stay as they are.
+	 * A note whose frames moved can no longer be packed.
+	 */
+	void applyFormat(const FrameTable::Format& format)
+	{
+		if (format.layout == FrameTable::Layout::frameMajor
+			&& frameTable.build(magGlobalLoop, alphaGlobalLoop, alphaLocalEnv1Loop, alphaLocalEnv2Loop, format)) {
+			magGlobalLoop.releaseData();
+			alphaGlobalLoop.releaseData();
+			alphaLocalEnv1Loop.releaseData();
+			alphaLocalEnv2Loop.releaseData();
+			this->format = format;
+		}
+		else {
+			this->format = partialMajor();
+		}
+	}
+
+	/** How the loop tables are stored, see applyFormat(). */
+	const FrameTable::Format& getFormat() const { return format; }
+
+	/**
+	 * The bytes held by each array of the note, loop tables included. Views
+	 * of a shared buffer are counted once, with the buffer.
+	 */
+	std::vector<ArrayBytes> getArrayBytes() const
+	{
+		const size_t env = alphaLocalEnv.getBytes() > 0 ? alphaLocalEnv.getBytes() : alphaLocalEnv1.getBytes() + alphaLocalEnv2.getBytes();
+		return {
+			{ "magGlobal", magGlobal.getBytes() },
+			{ "alphaGlobal", alphaGlobal.getBytes() },
+			{ "alphaLocal.env", env },
+			{ "envelope", envelope.getBytes() },
+			{ "attackWave", attackWave.getBytes() },
+			{ "alphaLocal (other)", alphaLocalSpreadingCenter.getBytes() + alphaLocalSpreadingFactor.getBytes()
+				+ alphaLocalNoiseGain.getBytes() + alphaLocalGain.getBytes() },
+			{ "magGlobal loop", magGlobalLoop.getBytes() },
+			{ "alphaGlobal loop", alphaGlobalLoop.getBytes() },
+			{ "alphaLocal.env loops", alphaLocalEnv1Loop.getBytes() + alphaLocalEnv2Loop.getBytes() },
+			{ "frame table", frameTable.getBytes() },
+		};
+	}
+
+	size_t getBytes() const
+	{
+		size_t bytes = 0;
+		for (const auto& array : getArrayBytes()) {
+			bytes += array.bytes;
+		}
+		return bytes;
+	}
+
+	/** Whether the arrays are pages of a mapped packed bank rather than heap memory. */
+	bool isMapped() const { return mapped; }
+
+    // the decoded buffer is adopted, not copied
+    ParamArray load_np_into_array(cnpy::NpzArchive& archive, std::string key, std::vector<size_t> shape) {
+		cnpy::NpyArray array = archive.load(key);
+		expectShape(array, key, shape);
+		return ParamArray(array);
     }
 
+	/**
+	 * Throws unless `array` is float32 with `shape`, where a 0 matches any
+	 * extent. An empty `shape` only asks for a non-empty array of any shape.
+	 */
+	static void expectShape(const cnpy::NpyArray& array, const std::string& key, const std::vector<size_t>& shape)
+	{
+		if (array.word_size != sizeof(float)) {
+			throw std::runtime_error("MFMParam: " + key + " is not float32");
+		}
+		bool ok = shape.empty() ? array.num_vals > 0 : array.shape.size() == shape.size();
+		for (size_t i = 0; ok && i < shape.size(); i++) {
+			ok = shape[i] == 0 || array.shape[i] == shape[i];
+		}
+		if (!ok) {
+			auto describe = [](const std::vector<size_t>& s) {
+				std::string text = "[";
+				for (size_t i = 0; i < s.size(); i++) {
+					text += (i > 0 ? ", " : "") + (s[i] == 0 ? std::string("*") : std::to_string(s[i]));
+				}
+				return text + "]";
+			};
+			throw std::runtime_error("MFMParam: " + key + " has shape " + describe(array.shape)
+				+ ", expected " + (shape.empty() ? std::string("a non-empty array") : describe(shape)));
+		}
+	}
+
+	/** The first value of a scalar array; throws if it is empty. */
+	template <typename T>
+	static T loadScalar(cnpy::NpzArchive& archive, const std::string& key)
+	{
+		const cnpy::NpyArray array = archive.load(key);
+		if (array.num_vals == 0 || array.word_size < sizeof(T)) {
+			throw std::runtime_error("MFMParam: " + key + " is empty");
+		}
+		return array.data<T>()[0];
+	}
+
+	/** The envelope frame at the end of the attack, which the voice scales the attack by; -1 for no attack. */
+	int getAttackEnvelopeIndex() const
+	{
+		return (int)(((float)attackLen) / sampleRate * param_sr) - 1;
+	}
+
+	/**
+	 * Throws unless the scalars fit the arrays the voice reads with them:
+	 * sampleRate and param_sr divide, attackWave holds attackLen samples
+	 * and envelope the frame at the end of the attack, which is not 0.
+	 */
+	void validate() const
+	{
+		if (sampleRate <= 0 || param_sr <= 0) {
+			throw std::runtime_error("MFMParam: sampleRate " + std::to_string(sampleRate) + " and par_sr "
+				+ std::to_string(param_sr) + " must be positive");
+		}
+		if (attackLen < 0 || (size_t)attackLen > attackWave.getSize()) {
+			throw std::runtime_error("MFMParam: attackLen " + std::to_string(attackLen) + " does not fit attackWave of "
+				+ std::to_string(attackWave.getSize()) + " samples");
+		}
+		const int index = getAttackEnvelopeIndex();
+		if (index < 0 || (size_t)index >= envelope.getSize() || envelope[(size_t)index] == 0) {
+			throw std::runtime_error("MFMParam: totalEnv of " + std::to_string(envelope.getSize())
+				+ " frames has no non-zero frame " + std::to_string(index) + " at the end of the attack");
+		}
+	}
+
 
 private:
-    
+	bool mapped = false;
+	// partial-major until applyFormat() moves the tables
+	FrameTable::Format format = partialMajor();
+
+	static FrameTable::Format partialMajor()
+	{
+		FrameTable::Format format;
+		format.layout = FrameTable::Layout::partialMajor;
+		return format;
+	}
 };
\ No newline at end of file
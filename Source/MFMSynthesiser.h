@@ -0,0 +1,207 @@
+/*
+  ==============================================================================
+
+    MFMSynthesiser.h
+    Created: 16 Oct 2026 9:58:26pm
+    Author:  a931e
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "SynthVoice.h"
+#include "RenderWorkerPool.h"
+
+/*
+ * juce::Synthesiser with a voice stealing policy for sustained, overlapping
+ * notes: instead of the oldest note, steal the voice that will be missed the
+ * least.
+ *
+ * With a worker pool and parallel rendering enabled, the sounding voices of a
+ * block render concurrently, each into its own scratch buffer; the buffers
+ * are then summed in voice order, so the output does not depend on which
+ * thread rendered what. Below parallelThreshold sounding voices the hand-off
+ * costs more than it saves and the voices render inline.
+ */
+class MFMSynthesiser : public juce::Synthesiser, private RenderWorkerPool::Task
+{
+public:
+	static constexpr int parallelThreshold = 4;
+	// the most voices the "polyphony" parameter allows
+	static constexpr int maxNumVoices = 64;
+
+	// so that adding voices up to maxNumVoices never reallocates the voice list
+	MFMSynthesiser()
+	{
+		voices.ensureStorageAllocated(maxNumVoices);
+	}
+
+	/** The pool must outlive the synthesiser. */
+	void setWorkerPool(RenderWorkerPool* pool)
+	{
+		workerPool = pool;
+	}
+
+	void setParallelRendering(bool shouldRenderInParallel)
+	{
+		parallel = shouldRenderInParallel;
+	}
+
+	/** Scratch buffers for a number of voices, see makeScratch(). */
+	struct Scratch
+	{
+		std::vector<juce::AudioBuffer<float>> buffers;
+		std::vector<juce::SynthesiserVoice*> jobVoices;
+		int numChannels = 0;
+		int maxBlockSize = 0;
+	};
+
+	/** Allocates a scratch buffer for each of `numVoices` voices; any thread. */
+	static Scratch makeScratch(int numVoices, int numChannels, int maxBlockSize)
+	{
+		Scratch result;
+		result.buffers.resize((size_t)numVoices);
+		for (auto& buffer : result.buffers)
+			buffer.setSize(numChannels, maxBlockSize);
+		result.jobVoices.resize((size_t)numVoices);
+		result.numChannels = numChannels;
+		result.maxBlockSize = maxBlockSize;
+		return result;
+	}
+
+	/**
+	 * Swaps in buffers from makeScratch(), sized for the voices there will
+	 * be, leaving the old ones in `other`. Does not allocate; call with the
+	 * audio callback locked out. Blocks render inline while there are more
+	 * voices than buffers.
+	 */
+	void swapScratch(Scratch& other)
+	{
+		scratch.swap(other.buffers);
+		jobVoices.swap(other.jobVoices);
+		std::swap(scratchChannels, other.numChannels);
+		std::swap(scratchSize, other.maxBlockSize);
+	}
+
+	/**
+	 * Sizes a scratch buffer for each voice. Call whenever the block size
+	 * changes, with the audio callback locked out or not yet running.
+	 */
+	void prepareScratch(int numChannels, int maxBlockSize)
+	{
+		auto buffers = makeScratch(voices.size(), numChannels, maxBlockSize);
+		swapScratch(buffers);
+	}
+
+	/**
+	 * Removes a voice without deleting it, so the caller can free it outside
+	 * the callback lock.
+	 */
+	std::unique_ptr<juce::SynthesiserVoice> takeVoice(int index)
+	{
+		const juce::ScopedLock sl(lock);
+		return std::unique_ptr<juce::SynthesiserVoice>(voices.removeAndReturn(index));
+	}
+
+	/**
+	 * In order of preference: a voice already playing the same note, the
+	 * quietest voice whose key has been released, the quietest voice.
+	 * Loudness is the peak of the voice's last block; the stolen voice fades
+	 * out over a few milliseconds, see SynthVoice::stopNote().
+	 */
+	juce::SynthesiserVoice* findVoiceToSteal(juce::SynthesiserSound* soundToPlay, int midiChannel, int midiNoteNumber) const override
+	{
+		juce::SynthesiserVoice* quietestReleased = nullptr;
+		juce::SynthesiserVoice* quietest = nullptr;
+		float quietestReleasedLevel = 0, quietestLevel = 0;
+
+		for (auto* voice : voices)
+		{
+			if (!voice->canPlaySound(soundToPlay))
+				continue;
+
+			if (voice->getCurrentlyPlayingNote() == midiNoteNumber && voice->isPlayingChannel(midiChannel))
+				return voice;
+
+			const float level = getLevel(voice);
+			if (voice->isPlayingButReleased() && (quietestReleased == nullptr || level < quietestReleasedLevel))
+			{
+				quietestReleased = voice;
+				quietestReleasedLevel = level;
+			}
+			if (quietest == nullptr || level < quietestLevel)
+			{
+				quietest = voice;
+				quietestLevel = level;
+			}
+		}
+
+		return quietestReleased != nullptr ? quietestReleased : quietest;
+	}
+
+protected:
+	void renderVoices(juce::AudioBuffer<float>& buffer, int startSample, int numSamples) override
+	{
+		if (workerPool == nullptr || workerPool->getNumWorkers() == 0 || !parallel
+			|| numSamples > scratchSize || buffer.getNumChannels() > scratchChannels || (int)scratch.size() < voices.size())
+		{
+			juce::Synthesiser::renderVoices(buffer, startSample, numSamples);
+			return;
+		}
+
+		numJobs = 0;
+		for (auto* voice : voices)
+		{
+			auto synthVoice = dynamic_cast<SynthVoice*>(voice);
+			if (synthVoice == nullptr || synthVoice->isRendering())
+				jobVoices[numJobs++] = voice;
+		}
+
+		if (numJobs < parallelThreshold)
+		{
+			for (int i = 0; i < numJobs; i++)
+				jobVoices[i]->renderNextBlock(buffer, startSample, numSamples);
+			return;
+		}
+
+		jobChannels = buffer.getNumChannels();
+		jobSamples = numSamples;
+		workerPool->run(*this, numJobs);
+
+		for (int i = 0; i < numJobs; i++)
+			for (int channel = 0; channel < jobChannels; channel++)
+				buffer.addFrom(channel, startSample, scratch[i], channel, 0, numSamples);
+	}
+
+private:
+	// renders one voice into its scratch buffer, on any thread of the pool
+	void run(int jobIndex) override
+	{
+		auto& target = scratch[jobIndex];
+		for (int channel = 0; channel < jobChannels; channel++)
+			target.clear(channel, 0, jobSamples);
+		jobVoices[jobIndex]->renderNextBlock(target, 0, jobSamples);
+	}
+
+	static float getLevel(juce::SynthesiserVoice* voice)
+	{
+		if (auto synthVoice = dynamic_cast<SynthVoice*>(voice))
+			return synthVoice->getOutputLevel();
+		return 0;
+	}
+
+	RenderWorkerPool* workerPool = nullptr;
+	bool parallel = false;
+
+	std::vector<juce::AudioBuffer<float>> scratch;
+	std::vector<juce::SynthesiserVoice*> jobVoices;
+	int scratchChannels = 0;
+	int scratchSize = 0;
+
+	// the block being rendered in parallel
+	int numJobs = 0;
+	int jobChannels = 0;
+	int jobSamples = 0;
+};
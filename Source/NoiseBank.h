@@ -0,0 +1,209 @@
+/*
+  ==============================================================================
+
+    NoiseBank.h
+    Created: 16 Oct 2026 11:52:19pm
+    Author:  a931e
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*
+ * Looped colored noise for the alphaLocal modulators, one table per colored
+ * cutoff of the loaded bank, generated at the output sample rate and shared
+ * read-only by every voice (and every plugin instance of the process).
+ *
+ * A table is uniform white noise through four passes of a 2nd order low pass
+ * at its cutoff, the same filter the voices used to apply at 2000 Hz before
+ * stretching the result to the cutoff. Each pass runs over the table twice,
+ * keeping only the second run, so the filter's state wraps around and the
+ * table loops without a seam. Tables are scaled to the level of the 2000 Hz
+ * noise, so the modulation depth does not depend on the cutoff.
+ *
+ * Cutoffs are rounded to semitones, which bounds the number of tables for a
+ * bank with per-note cutoffs. A table holds about tableCycles periods of its
+ * cutoff, rounded up to a power of two so that readers wrap with a mask.
+ */
+class NoiseBank
+{
+public:
+	struct Table
+	{
+		float cutoff = 0;
+		unsigned int mask = 0;
+		std::vector<float> samples;
+
+		float operator[](unsigned int i) const { return samples[i & mask]; }
+	};
+
+	/**
+	 * A bank with a table for each of `cutoffs` at `sampleRate`. Tables that
+	 * are still alive anywhere in the process are reused instead of rebuilt.
+	 * Call from the message thread; building a table takes a few milliseconds.
+	 */
+	static std::shared_ptr<const NoiseBank> create(double sampleRate, const std::vector<float>& cutoffs)
+	{
+		auto bank = std::make_shared<NoiseBank>();
+		bank->sampleRate = sampleRate;
+		if (sampleRate <= 0) {
+			return bank;
+		}
+
+		std::vector<int> keys;
+		for (float cutoff : cutoffs) {
+			keys.push_back(getKey(cutoff, sampleRate));
+		}
+		std::sort(keys.begin(), keys.end());
+		keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+		for (int key : keys) {
+			bank->tables.push_back(getSharedTable(sampleRate, key));
+		}
+		return bank;
+	}
+
+	double getSampleRate() const { return sampleRate; }
+
+	bool isEmpty() const { return tables.empty(); }
+
+	/** The bytes of the tables, which may be shared with other banks. */
+	size_t getBytes() const
+	{
+		size_t bytes = 0;
+		for (const auto& table : tables) {
+			bytes += table->samples.size() * sizeof(float);
+		}
+		return bytes;
+	}
+
+	/** The table closest to `cutoff`, nullptr if the bank is empty. Does not allocate. */
+	const Table* find(float cutoff) const
+	{
+		if (tables.empty()) {
+			return nullptr;
+		}
+		const float target = getCutoff(getKey(cutoff, sampleRate));
+		auto it = std::lower_bound(tables.begin(), tables.end(), target,
+			[](const std::shared_ptr<const Table>& table, float c) { return table->cutoff < c; });
+		if (it == tables.end()) {
+			return tables.back().get();
+		}
+		if (it != tables.begin() && target / (*(it - 1))->cutoff < (*it)->cutoff / target) {
+			--it;
+		}
+		return it->get();
+	}
+
+private:
+	static constexpr float referenceCutoff = 2000;
+	static constexpr float tableCycles = 512;
+	static constexpr int minTableOrder = 15, maxTableOrder = 18;
+	static constexpr int numFilterPasses = 4;
+
+	double sampleRate = 0;
+	// sorted by cutoff
+	std::vector<std::shared_ptr<const Table>> tables;
+
+	// semitones above 1 Hz, below Nyquist
+	static int getKey(float cutoff, double sampleRate)
+	{
+		const double limit = 0.45 * sampleRate;
+		const double c = std::isfinite(cutoff) ? juce::jlimit(1.0, limit, (double)cutoff) : referenceCutoff;
+		return std::min((int)std::round(12 * std::log2(c)), (int)std::floor(12 * std::log2(limit)));
+	}
+
+	static float getCutoff(int key) { return (float)std::exp2(key / 12.0); }
+
+	static std::shared_ptr<const Table> getSharedTable(double sampleRate, int key)
+	{
+		static std::mutex lock;
+		static std::map<std::pair<double, int>, std::weak_ptr<const Table>> cache;
+
+		std::lock_guard<std::mutex> guard(lock);
+		auto& entry = cache[{ sampleRate, key }];
+		auto table = entry.lock();
+		if (table == nullptr) {
+			table = buildTable(sampleRate, key);
+			entry = table;
+		}
+		return table;
+	}
+
+	static std::shared_ptr<const Table> buildTable(double sampleRate, int key)
+	{
+		auto table = std::make_shared<Table>();
+		table->cutoff = getCutoff(key);
+
+		const double cycles = sampleRate / table->cutoff * tableCycles;
+		int order = minTableOrder;
+		while (order < maxTableOrder && (double)(1 << order) < cycles) {
+			order++;
+		}
+		const int length = 1 << order;
+		table->mask = (unsigned int)length - 1;
+		table->samples.resize(length);
+
+		// the same noise for a cutoff every time, so a bank reload sounds the same
+		juce::Random random(key);
+		for (auto& sample : table->samples) {
+			sample = random.nextFloat() * 2 - 1;
+		}
+
+		const auto coefficients = juce::dsp::IIR::Coefficients<float>::makeLowPass(sampleRate, table->cutoff);
+		for (int pass = 0; pass < numFilterPasses; pass++) {
+			juce::dsp::IIR::Filter<float> filter(coefficients);
+			for (float sample : table->samples) {
+				filter.processSample(sample);
+			}
+			for (auto& sample : table->samples) {
+				sample = filter.processSample(sample);
+			}
+		}
+
+		// uniform white noise has a power of 1/3
+		double power = 0;
+		for (float sample : table->samples) {
+			power += (double)sample * sample;
+		}
+		power /= length;
+		const double targetPower = getNoiseGain(sampleRate, referenceCutoff) / 3;
+		if (power > 0) {
+			const float scale = (float)std::sqrt(targetPower / power);
+			for (auto& sample : table->samples) {
+				sample *= scale;
+			}
+		}
+		return table;
+	}
+
+	// the power gain of the filter cascade for white noise: its squared impulse response summed
+	static double getNoiseGain(double sampleRate, float cutoff)
+	{
+		const auto coefficients = juce::dsp::IIR::Coefficients<float>::makeLowPass(sampleRate, cutoff);
+		juce::dsp::IIR::Filter<float> filters[numFilterPasses];
+		for (auto& filter : filters) {
+			filter.coefficients = coefficients;
+		}
+
+		double gain = 0;
+		const int length = (int)(sampleRate / cutoff * 64) + 64;
+		for (int n = 0; n < length; n++) {
+			float y = n == 0 ? 1.0f : 0.0f;
+			for (auto& filter : filters) {
+				y = filter.processSample(y);
+			}
+			gain += (double)y * y;
+		}
+		return gain;
+	}
+};
@@ -0,0 +1,255 @@
+/*
+  ==============================================================================
+
+    PackedBank.h
+    Created: 17 Oct 2026 2:10:37am
+    Author:  a931e
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include "FrameTable.h"
+
+/*
+ * A whole bank in one .mfmbank file, memory mapped and read in place: the
+ * MFMParams of a packed bank point straight into the mapping, so opening a
+ * bank costs a few page faults and processes that open the same file share
+ * its pages through the page cache.
+ *
+ * Layout, little endian, every array 64-byte aligned float32:
+ *
+ *   FileHeader | arrays ... | NoteRecord[numNotes], sorted by MIDI note
+ *
+ * A NoteRecord holds the note's scalars and, for each array, its offset from
+ * the start of the file and its element count. alphaLocal.env is stored
+ * already split into env1 and env2, and the four looped tables the voices
+ * read are stored as LoopTable::build() lays them out, for the loop points
+ * in the header, so nothing is computed at load.
+ *
+ * The tables are always stored float32 and partial-major. The header holds
+ * the FrameTable::Format the bank was compiled for (see getFormat()), and
+ * MFMBank applies it when it opens the bank: for the frame-major layout it
+ * builds the frame tables from the mapped loop tables, which costs a
+ * transpose per note but no decoding, and only a partial-major bank keeps
+ * its tables in the mapping. Version 1 files, without the format, are
+ * partial-major float32.
+ *
+ * A mapped file must not change while it is open: replace a bank by writing
+ * a new file and renaming it over the old one, which MFMBank::writePacked()
+ * does.
+ */
+class PackedBank
+{
+public:
+	static constexpr char magic[8] = { 'M', 'F', 'M', 'B', 'A', 'N', 'K', 0 };
+	static constexpr uint32_t version = 2;
+	static constexpr int alignment = 64;
+
+	struct FileHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t numNotes;
+		uint64_t indexOffset;
+		uint64_t fileSize;
+		// the loop points the tables were built with
+		float loopStartSeconds, loopEndSeconds, overlapSeconds;
+		// the FrameTable::Format, per array as precision.txt names them:
+		// magGlobal, alphaGlobal and alphaLocalEnv (both envelopes); all 0,
+		// partial-major float32, in version 1
+		uint8_t layout;
+		uint8_t encodings[3];
+		float tolerances[3];
+		uint8_t reserved[4];
+	};
+
+	struct ArrayRef
+	{
+		uint64_t offset;
+		uint64_t count;
+	};
+
+	struct LoopRef
+	{
+		ArrayRef data, maxAbs, maxAbsSlope;
+		int32_t length, loopEnd, loopLength, reserved;
+	};
+
+	struct NoteRecord
+	{
+		int32_t midiNote, numPartials, numSamples, paramSr, attackLen, sampleRate;
+		float baseFreq, coloredCutoff1, coloredCutoff2;
+		int32_t reserved;
+		ArrayRef magGlobal, attackWave, alphaGlobal, envelope;
+		ArrayRef spreadingCenter, spreadingFactor, noiseGain, gain, env1, env2;
+		LoopRef magGlobalLoop, alphaGlobalLoop, env1Loop, env2Loop;
+	};
+
+	static_assert(sizeof(FileHeader) == 64, "the header is part of the file format");
+	static_assert(sizeof(NoteRecord) == 40 + 10 * 16 + 4 * 64, "records are part of the file format");
+
+	/** Maps and validates a packed bank; returns nullptr and sets `error` if it is not one. */
+	static std::shared_ptr<const PackedBank> open(const juce::File& file, juce::String& error)
+	{
+		auto bank = std::shared_ptr<PackedBank>(new PackedBank());
+		bank->map = std::make_unique<juce::MemoryMappedFile>(file, juce::MemoryMappedFile::readOnly);
+		bank->base = static_cast<const char*>(bank->map->getData());
+		bank->size = bank->map->getSize();
+		if (bank->base == nullptr) {
+			error = "unable to map " + file.getFullPathName();
+			return nullptr;
+		}
+		if (!bank->validate(error)) {
+			error = file.getFileName() + ": " + error;
+			return nullptr;
+		}
+		return bank;
+	}
+
+	const FileHeader& getHeader() const { return *reinterpret_cast<const FileHeader*>(base); }
+
+	/** The format the bank was compiled for, see FileHeader. */
+	FrameTable::Format getFormat() const
+	{
+		const auto& header = getHeader();
+		FrameTable::Format format;
+		format.layout = (FrameTable::Layout)header.layout;
+		for (int q = 0; q < FrameTable::numQuantities; q++) {
+			const int field = std::min(q, 2);
+			format.set((FrameTable::Quantity)q, (FrameTable::Encoding)header.encodings[field],
+				header.encodings[field] == (uint8_t)FrameTable::Encoding::breakpoints ? header.tolerances[field] : FrameTable::defaultTolerance);
+		}
+		return format;
+	}
+
+	/** Stores `format` in `header`; false if the two envelopes differ, which the file cannot hold. */
+	static bool setFormat(FileHeader& header, const FrameTable::Format& format)
+	{
+		if (format.encodings[FrameTable::env1] != format.encodings[FrameTable::env2]
+			|| format.tolerances[FrameTable::env1] != format.tolerances[FrameTable::env2]) {
+			return false;
+		}
+		header.layout = (uint8_t)format.layout;
+		for (int field = 0; field < 3; field++) {
+			header.encodings[field] = (uint8_t)format.encodings[field];
+			header.tolerances[field] = format.encodings[field] == FrameTable::Encoding::breakpoints ? format.tolerances[field] : 0;
+		}
+		return true;
+	}
+	int getNumNotes() const { return (int)getHeader().numNotes; }
+
+	const NoteRecord& getNote(int index) const
+	{
+		return reinterpret_cast<const NoteRecord*>(base + getHeader().indexOffset)[index];
+	}
+
+	const float* getFloats(const ArrayRef& array) const
+	{
+		return reinterpret_cast<const float*>(base + array.offset);
+	}
+
+	static uint64_t align(uint64_t offset)
+	{
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+private:
+	PackedBank() {}
+
+	bool validate(juce::String& error) const
+	{
+		if (size < sizeof(FileHeader)) {
+			error = "too short";
+			return false;
+		}
+		const auto& header = getHeader();
+		if (std::memcmp(header.magic, magic, sizeof(magic)) != 0) {
+			error = "not a packed bank";
+			return false;
+		}
+		if (header.version != version && header.version != 1) {
+			error = "unsupported version " + juce::String(header.version);
+			return false;
+		}
+		if (header.layout > (uint8_t)FrameTable::Layout::frameMajor) {
+			error = "unknown table layout";
+			return false;
+		}
+		for (int field = 0; field < 3; field++) {
+			if (header.encodings[field] > (uint8_t)FrameTable::Encoding::breakpoints || !(header.tolerances[field] >= 0)) {
+				error = "unknown table encoding";
+				return false;
+			}
+		}
+		if (header.layout == (uint8_t)FrameTable::Layout::partialMajor && !getFormat().isFloat32()) {
+			error = "table encodings without the frame-major layout";
+			return false;
+		}
+		if (header.fileSize != size || header.indexOffset % alignof(NoteRecord) != 0
+			|| header.indexOffset > size || (size - header.indexOffset) / sizeof(NoteRecord) < header.numNotes) {
+			error = "truncated or corrupt index";
+			return false;
+		}
+		for (int i = 0; i < getNumNotes(); i++) {
+			const auto& note = getNote(i);
+			if (!juce::isPositiveAndBelow(note.midiNote, 128) || (i > 0 && note.midiNote <= getNote(i - 1).midiNote)) {
+				error = "note " + juce::String(note.midiNote) + " out of range or out of order";
+				return false;
+			}
+			const size_t rows = (size_t)std::max(note.numPartials, 0);
+			const size_t frames = (size_t)rows * std::max(note.numSamples, 0);
+			const bool ok = note.numPartials > 0 && note.numSamples > 0
+				&& check(note.magGlobal, frames) && check(note.alphaGlobal, frames) && check(note.envelope)
+				&& check(note.attackWave) && check(note.env1, frames) && check(note.env2, frames)
+				&& check(note.spreadingCenter, rows * 2) && check(note.spreadingFactor, rows * 2)
+				&& check(note.noiseGain, rows * 2) && check(note.gain, rows)
+				&& check(note.magGlobalLoop, rows) && check(note.alphaGlobalLoop, rows)
+				&& check(note.env1Loop, rows) && check(note.env2Loop, rows);
+			if (!ok) {
+				error = "corrupt arrays for note " + juce::String(note.midiNote);
+				return false;
+			}
+			if (!checkScalars(note)) {
+				error = "scalars of note " + juce::String(note.midiNote) + " do not fit its arrays";
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// what MFMParam::validate() asks of a note file, for the arrays' counts
+	bool checkScalars(const NoteRecord& note) const
+	{
+		if (note.sampleRate <= 0 || note.paramSr <= 0 || note.attackLen < 0 || (uint64_t)note.attackLen > note.attackWave.count) {
+			return false;
+		}
+		// the envelope frame at the end of the attack, see MFMParam::getAttackEnvelopeIndex()
+		const int index = (int)(((float)note.attackLen) / note.sampleRate * note.paramSr) - 1;
+		return index >= 0 && (uint64_t)index < note.envelope.count && getFloats(note.envelope)[index] != 0;
+	}
+
+	// an aligned array inside the file, of `count` elements if given
+	bool check(const ArrayRef& array, size_t count = 0) const
+	{
+		return array.offset % alignment == 0 && array.offset <= size
+			&& array.count <= (size - array.offset) / sizeof(float)
+			&& (count == 0 || array.count == count);
+	}
+
+	bool check(const LoopRef& loop, size_t rows) const
+	{
+		return loop.length > 0 && loop.length == loop.loopEnd + loop.loopLength + 1
+			&& check(loop.data, rows * loop.length) && check(loop.maxAbs, rows) && check(loop.maxAbsSlope, rows);
+	}
+
+	std::unique_ptr<juce::MemoryMappedFile> map;
+	const char* base = nullptr;
+	size_t size = 0;
+};
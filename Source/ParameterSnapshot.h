@@ -0,0 +1,85 @@
+/*
+  ==============================================================================
+
+    ParameterSnapshot.h
+    Created: 16 Oct 2026 4:02:55pm
+    Author:  a931e
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+
+/*
+ * The parameters read on the audio thread. Their atomics and parameter objects
+ * are looked up by id once in attach(); after that the processor takes one
+ * snapshot per block with update() and the voices read plain floats from it,
+ * without any string or map work.
+ */
+class ParameterSnapshot
+{
+public:
+	enum Id {
+		gain,
+		attack,
+		inputChannel,
+		intensity,
+		roughness,
+		pitchVariance,
+		bowPosition,
+		resonance,
+		sharpness,
+		vibrato,
+		oscillator,
+		parallelRender,
+		numParameters
+	};
+
+	static const char* getParameterId(int id)
+	{
+		static const char* ids[numParameters] = {
+			"gain", "attack", "inputChannel", "intensity", "roughness",
+			"pitchVariance", "bowPosition", "resonance", "sharpness", "vibrato",
+			"oscillator", "parallelRender"
+		};
+		return ids[id];
+	}
+
+	void attach(AudioProcessorValueTreeState& valueTree)
+	{
+		for (int i = 0; i < numParameters; i++) {
+			raw[i] = valueTree.getRawParameterValue(getParameterId(i));
+			parameters[i] = valueTree.getParameter(getParameterId(i));
+			jassert(raw[i] != nullptr && parameters[i] != nullptr);
+		}
+		update();
+	}
+
+	/** Takes this block's snapshot. */
+	void update()
+	{
+		for (int i = 0; i < numParameters; i++) {
+			values[i] = raw[i]->load();
+		}
+	}
+
+	float operator[](int id) const { return values[id]; }
+
+	/**
+	 * Sets a parameter from the audio thread (MIDI CC, pitch wheel) and
+	 * notifies the host. The snapshot sees the new value immediately.
+	 */
+	void setNormalised(Id id, float normalisedValue)
+	{
+		parameters[id]->setValueNotifyingHost(normalisedValue);
+		values[id] = raw[id]->load();
+	}
+
+private:
+	std::array<std::atomic<float>*, numParameters> raw{};
+	std::array<RangedAudioParameter*, numParameters> parameters{};
+	std::array<float, numParameters> values{};
+};
@@ -0,0 +1,581 @@
+/*
+  ==============================================================================
+
+    PartialBank.h
+    Created: 16 Oct 2026 10:40:02am
+    Author:  a931e
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+#include "SIMD.h"
+#include "LoopTable.h"
+#include "FrameTable.h"
+
+/*
+ * Per-voice state of all partials in structure-of-arrays form, and the kernel
+ * that renders one output sample from it. Every array is aligned and padded to
+ * a whole number of SIMD vectors; padding lanes have zero magnitude so they
+ * never contribute to the output.
+ *
+ * The voice fills the per-note, per-block and per-sample inputs, the bank owns
+ * the carrier phases and the table values of the current parameter frame.
+ *
+ * Carriers can be rendered two ways:
+ *
+ * - direct: one sin() per partial per sample, as the synth always did.
+ * - recurrence: the partials are exact harmonics, so the carrier of partial n
+ *   is e^{i n theta}. Each block we re-anchor every carrier exactly and build
+ *   the per-sample rotors r_n = r_1^n from one fundamental rotor by repeated
+ *   multiplication; per sample a carrier is advanced by one complex multiply.
+ *   The phase modulation alpha is applied as a rotation by the small angle
+ *   delta = alpha - alpha0, where alpha0 is alphaGlobal at the block start and
+ *   is folded into the anchor, with sin/cos(delta) from short Taylor series.
+ *
+ *   beginRecurrenceBlock() only accepts a block if no |delta| can exceed
+ *   maxCorrectionAngle (1 rad); otherwise the block has to be rendered direct.
+ *   Within that range, per partial and per unit of mag * magControl, a block
+ *   of up to 512 samples differs from the direct kernel by at most 5e-5:
+ *     1.2e-5  error of the Pade sin() used by the direct kernel itself
+ *     3e-7    Taylor remainder of sin/cos(delta) for |delta| <= 1
+ *     3e-5    float rounding of the rotor and of the direct kernel's phase
+ *             accumulator over the block
+ *   so a note deviates by at most 5e-5 * sum_i |mag_i * magControl_i|;
+ *   `KernelBench recurrence` (Tools/KernelBench) measures 9e-6. Across
+ *   blocks the phases are advanced by whole blocks, which drifts less than
+ *   the direct kernel's per-sample accumulation; the two modes slowly
+ *   diverge in phase by that drift (KernelBench: up to 6e-4 cycles after two
+ *   seconds over 64 partials of A3, 9e-4 over 200), not in spectrum.
+ *
+ * Every block, beginBlock() culls the partials at or above Nyquist and the
+ * ones more than 80 dB below the loudest, with hysteresis, and fades them out
+ * and back in. The kernels only visit the vectors that hold an audible
+ * partial; endBlock() keeps the phases of the others running.
+ */
+class PartialBank
+{
+public:
+	PartialBank() {}
+
+	PartialBank(const PartialBank&) = delete;
+	PartialBank& operator=(const PartialBank&) = delete;
+
+	void allocate(int maxPartials)
+	{
+		capacity = simd::padToWidth(maxPartials);
+		storage.allocate((size_t)capacity * numArrays);
+		assignArrays();
+		activeVectors.assign(capacity / simd::width, 0);
+		inactiveVectors.assign(capacity / simd::width, 0);
+		segments.assign((size_t)capacity * FrameTable::numQuantities, -1);
+		numPartials = 0;
+		numPadded = 0;
+		numActiveVectors = 0;
+		numInactiveVectors = 0;
+	}
+
+	/**
+	 * Takes over the arrays of `larger`, a bank allocate()d for more
+	 * partials, keeping the state of the note that is playing, where
+	 * allocate() starts over: the state is copied into `larger`'s arrays and
+	 * the two banks swap them, so this does not allocate and `larger` is
+	 * left with the old arrays, to be freed elsewhere. The partials added
+	 * are silent.
+	 */
+	void grow(PartialBank& larger)
+	{
+		if (larger.capacity <= capacity) {
+			return;
+		}
+		for (int a = 0; a < numArrays && capacity > 0; a++) {
+			std::copy(storage.get() + (size_t)a * capacity, storage.get() + (size_t)(a + 1) * capacity,
+				larger.storage.get() + (size_t)a * larger.capacity);
+		}
+		// the offsets of the vectors into each array are unchanged
+		std::copy(activeVectors.begin(), activeVectors.end(), larger.activeVectors.begin());
+		std::copy(inactiveVectors.begin(), inactiveVectors.end(), larger.inactiveVectors.begin());
+		for (int q = 0; q < FrameTable::numQuantities && capacity > 0; q++) {
+			std::copy(segments.begin() + (size_t)q * capacity, segments.begin() + (size_t)(q + 1) * capacity,
+				larger.segments.begin() + (size_t)q * larger.capacity);
+		}
+
+		storage.swap(larger.storage);
+		std::swap(capacity, larger.capacity);
+		activeVectors.swap(larger.activeVectors);
+		inactiveVectors.swap(larger.inactiveVectors);
+		segments.swap(larger.segments);
+		assignArrays();
+		larger.assignArrays();
+	}
+
+	/** Sets the partial count of the next note and clears every array. */
+	void reset(int numPartials)
+	{
+		jassert(numPartials <= capacity);
+		this->numPartials = std::min(numPartials, capacity);
+		numPadded = simd::padToWidth(this->numPartials);
+		std::fill(storage.get(), storage.get() + storage.getSize(), 0.0f);
+		std::fill(segments.begin(), segments.end(), -1);
+		numActiveVectors = 0;
+		numInactiveVectors = 0;
+		firstBlock = true;
+	}
+
+	int getNumPartials() const { return numPartials; }
+	int getCapacity() const { return capacity; }
+
+	size_t getBytes() const
+	{
+		return storage.getSize() * sizeof(float) + (activeVectors.capacity() + inactiveVectors.capacity() + segments.capacity()) * sizeof(int);
+	}
+
+	/**
+	 * Loads the values at `frame` of the looped tables and the slopes towards
+	 * the next frame. Only needed when the integer frame changes, which at the
+	 * parameter rate is once every few hundred samples.
+	 */
+	void loadFrame(const LoopTable& mag, const LoopTable& alphaGlobal, const LoopTable& env1, const LoopTable& env2, int frame)
+	{
+		loadFrame(mag, frame, magStart, magSlope);
+		loadFrame(alphaGlobal, frame, alphaGlobalStart, alphaGlobalSlope);
+		loadFrame(env1, frame, env1Start, env1Slope);
+		loadFrame(env2, frame, env2Start, env2Slope);
+	}
+
+	/**
+	 * The same from a frame-major table: rows `frame` and `frame` + 1,
+	 * decoded front to back, and for quantities stored as breakpoints each
+	 * partial's segment, moved on from the one used at the last frame.
+	 */
+	void loadFrame(const FrameTable& table, int frame)
+	{
+		loadFrame(table, FrameTable::mag, frame, magStart, magSlope);
+		loadFrame(table, FrameTable::alphaGlobal, frame, alphaGlobalStart, alphaGlobalSlope);
+		loadFrame(table, FrameTable::env1, frame, env1Start, env1Slope);
+		loadFrame(table, FrameTable::env2, frame, env2Start, env2Slope);
+	}
+
+	/**
+	 * Decides which partials are audible in the next `numSamples` samples, from
+	 * carrierInc, magControl and the loaded frame, and plans their fades.
+	 * A partial is switched off at or above Nyquist or 80 dB below the loudest
+	 * partial and back on below 0.49 cycles per sample and above -74 dB; fades
+	 * move by at most `fadeStep` per sample. A new note starts without fades.
+	 * Partials from `maxAudible` up are switched off as well.
+	 */
+	void beginBlock(int numSamples, float fadeStep, int maxAudible)
+	{
+		float loudest = 0;
+		for (int i = 0; i < numPartials; i++) {
+			loudest = std::max(loudest, getLevel(i));
+		}
+
+		const float maxFade = fadeStep * numSamples;
+		for (int i = 0; i < numPartials; i++) {
+			const float level = getLevel(i);
+			if (i >= maxAudible) {
+				fadeTarget[i] = 0;
+			}
+			else if (fadeTarget[i] > 0) {
+				if (carrierInc[i] >= 0.5f || level < loudest * 1e-4f) {
+					fadeTarget[i] = 0;
+				}
+			}
+			else if (carrierInc[i] < 0.49f && level > loudest * 2e-4f) {
+				fadeTarget[i] = 1;
+			}
+			if (firstBlock) {
+				fade[i] = fadeTarget[i];
+			}
+			fadeEnd[i] = fade[i] + juce::jlimit(-maxFade, maxFade, fadeTarget[i] - fade[i]);
+			gainStart[i] = magControl[i] * fade[i];
+			gainSlope[i] = magControl[i] * (fadeEnd[i] - fade[i]) / numSamples;
+		}
+		firstBlock = false;
+
+		numActiveVectors = 0;
+		numInactiveVectors = 0;
+		for (int i = 0; i < numPadded; i += simd::width) {
+			bool audible = false;
+			for (int j = i; j < std::min(i + simd::width, numPartials); j++) {
+				audible = audible || fade[j] > 0 || fadeEnd[j] > 0;
+			}
+			if (audible) {
+				activeVectors[numActiveVectors++] = i;
+			}
+			else {
+				inactiveVectors[numInactiveVectors++] = i;
+			}
+		}
+		blockSample = 0;
+	}
+
+	/** Keeps the culled partials' phases running and completes the fades. */
+	void endBlock(int numSamples)
+	{
+		for (int k = 0; k < numInactiveVectors; k++) {
+			const int i = inactiveVectors[k];
+			advance(carrierPhase + i, carrierInc + i, simd::width, numSamples);
+			advance(modPhase1 + i, modInc1 + i, simd::width, numSamples);
+			advance(modPhase2 + i, modInc2 + i, simd::width, numSamples);
+		}
+		std::copy(fadeEnd, fadeEnd + numPartials, fade);
+	}
+
+	/**
+	 * Renders one sample `frac` of the way between the loaded frame and the next:
+	 *
+	 *   sum_i mag_i * magControl_i * sin(2 pi ft_i + alphaGlobal_i + alphaLocal_i)
+	 *
+	 * where alphaLocal_i = alphaControl * (sin(2 pi m1_i + fac1_i noise1_i) * env1_i * gain1_i
+	 *                                    + sin(2 pi m2_i + fac2_i noise2_i) * env2_i * gain2_i)
+	 *
+	 * with the modulator phases m_i = c_i t - 0.5, and advances every carrier
+	 * and modulator phase by its increment. Only the partials beginBlock()
+	 * found audible are rendered, with their fades applied.
+	 */
+	float renderSample(float frac, float alphaControl)
+	{
+		using namespace simd;
+
+		const Float vTwoPi = broadcast(twoPi);
+		const Float vFrac = broadcast(frac);
+		const Float vAlphaControl = broadcast(alphaControl);
+		const Float vBlockSample = broadcast((float)++blockSample);
+		Float y = zero();
+
+		for (int k = 0; k < numActiveVectors; k++) {
+			const int i = activeVectors[k];
+			const Float phase = wrapPhase(add(load(carrierPhase + i), load(carrierInc + i)));
+			store(carrierPhase + i, phase);
+
+			const Float alphaGlobal = mulAdd(load(alphaGlobalSlope + i), vFrac, load(alphaGlobalStart + i));
+			const Float alpha = mulAdd(getAlphaLocal(i, vFrac), vAlphaControl, alphaGlobal);
+			const Float carrier = simd::sin(mulAdd(vTwoPi, phase, alpha));
+			const Float mag = mulAdd(load(magSlope + i), vFrac, load(magStart + i));
+			const Float gain = mulAdd(load(gainSlope + i), vBlockSample, load(gainStart + i));
+			y = mulAdd(mul(mag, gain), carrier, y);
+		}
+		return sum(y);
+	}
+
+	/**
+	 * Prepares a block of `numSamples` recurrence samples starting `frac` of
+	 * the way into the loaded frame, during which the table cursor moves by at
+	 * most `numFrames` frames. Returns false, and changes nothing, if the phase
+	 * modulation could rotate a carrier by more than maxCorrectionAngle away
+	 * from its anchor; render that block with renderSample() instead.
+	 *
+	 * carrierInc must be harmonic, carrierInc[i] == (i + 1) * carrierInc[0].
+	 */
+	bool beginRecurrenceBlock(float frac, float alphaControl, double numFrames)
+	{
+		for (int i = 0; i < numPartials; i++) {
+			const double bound = alphaLocalBound[i] * std::abs(alphaControl) + alphaGlobalRate[i] * numFrames;
+			if (bound > maxCorrectionAngle && (fade[i] > 0 || fadeEnd[i] > 0)) {
+				return false;
+			}
+		}
+
+		// r_n = r_1^n, in double so the rounding does not build up with n
+		const double fundamental = twoPiDouble * carrierInc[0];
+		const double r1Re = std::cos(fundamental), r1Im = std::sin(fundamental);
+		double rRe = r1Re, rIm = r1Im;
+		for (int i = 0; i < numPartials; i++) {
+			rotorRe[i] = (float)rRe;
+			rotorIm[i] = (float)rIm;
+			const double re = rRe * r1Re - rIm * r1Im;
+			rIm = rRe * r1Im + rIm * r1Re;
+			rRe = re;
+		}
+
+		// anchor every carrier at its first sample, with alpha0 folded in
+		for (int i = 0; i < numPartials; i++) {
+			alphaAnchor[i] = alphaGlobalStart[i] + alphaGlobalSlope[i] * frac;
+			const double angle = twoPiDouble * ((double)carrierPhase[i] + carrierInc[i]) + alphaAnchor[i];
+			carrierRe[i] = (float)std::cos(angle);
+			carrierIm[i] = (float)std::sin(angle);
+		}
+		return true;
+	}
+
+	/**
+	 * Same output as renderSample(), from the carriers set up by
+	 * beginRecurrenceBlock(). No transcendental function is evaluated for the
+	 * carriers; the alphaLocal modulators still are.
+	 */
+	float renderSampleRecurrence(float frac, float alphaControl)
+	{
+		using namespace simd;
+
+		const Float vFrac = broadcast(frac);
+		const Float vAlphaControl = broadcast(alphaControl);
+		const Float vBlockSample = broadcast((float)++blockSample);
+		Float y = zero();
+
+		for (int k = 0; k < numActiveVectors; k++) {
+			const int i = activeVectors[k];
+			const Float alphaGlobal = mulAdd(load(alphaGlobalSlope + i), vFrac, load(alphaGlobalStart + i));
+			const Float alpha = mulAdd(getAlphaLocal(i, vFrac), vAlphaControl, alphaGlobal);
+			const Float delta = sub(alpha, load(alphaAnchor + i));
+
+			// sin(delta) to delta^9, cos(delta) to delta^8
+			const Float d2 = mul(delta, delta);
+			Float sinDelta = mulAdd(d2, broadcast(1.0f / 362880), broadcast(-1.0f / 5040));
+			sinDelta = mulAdd(d2, sinDelta, broadcast(1.0f / 120));
+			sinDelta = mulAdd(d2, sinDelta, broadcast(-1.0f / 6));
+			sinDelta = mulAdd(mul(d2, delta), sinDelta, delta);
+			Float cosDelta = mulAdd(d2, broadcast(1.0f / 40320), broadcast(-1.0f / 720));
+			cosDelta = mulAdd(d2, cosDelta, broadcast(1.0f / 24));
+			cosDelta = mulAdd(d2, cosDelta, broadcast(-0.5f));
+			cosDelta = mulAdd(d2, cosDelta, broadcast(1.0f));
+
+			// Im(carrier * e^{i delta}), then step the carrier by its rotor
+			const Float re = load(carrierRe + i);
+			const Float im = load(carrierIm + i);
+			const Float carrier = mulAdd(im, cosDelta, mul(re, sinDelta));
+			const Float rotRe = load(rotorRe + i);
+			const Float rotIm = load(rotorIm + i);
+			store(carrierRe + i, sub(mul(re, rotRe), mul(im, rotIm)));
+			store(carrierIm + i, mulAdd(re, rotIm, mul(im, rotRe)));
+
+			const Float mag = mulAdd(load(magSlope + i), vFrac, load(magStart + i));
+			const Float gain = mulAdd(load(gainSlope + i), vBlockSample, load(gainStart + i));
+			y = mulAdd(mul(mag, gain), carrier, y);
+		}
+		return sum(y);
+	}
+
+	/**
+	 * Advances the audible carrier phases past a block that was not rendered
+	 * with renderSample(), e.g. with renderSampleRecurrence().
+	 */
+	void advanceCarriers(int numSamples)
+	{
+		for (int k = 0; k < numActiveVectors; k++) {
+			const int i = activeVectors[k];
+			advance(carrierPhase + i, carrierInc + i, simd::width, numSamples);
+		}
+	}
+
+	/** Advances the audible modulator phases past a block that did not evaluate alphaLocal per sample. */
+	void advanceModulators(int numSamples)
+	{
+		for (int k = 0; k < numActiveVectors; k++) {
+			const int i = activeVectors[k];
+			advance(modPhase1 + i, modInc1 + i, simd::width, numSamples);
+			advance(modPhase2 + i, modInc2 + i, simd::width, numSamples);
+		}
+	}
+
+	/**
+	 * Evaluates every partial `numSamplesAhead` samples after the last one
+	 * rendered, where the table cursor is at `tablePosition`, for the spectral
+	 * engine: amplitude is mag * magControl faded as at the end of the block,
+	 * phase the full carrier phase in radians. Culled partials get amplitude 0.
+	 * noise1 and noise2 must hold the noise at that sample.
+	 */
+	void evaluate(const LoopTable& mag, const LoopTable& alphaGlobal, const LoopTable& env1, const LoopTable& env2,
+		double tablePosition, int numSamplesAhead, float alphaControl, float* amplitude, float* phase) const
+	{
+		const LoopTable* tables[FrameTable::numQuantities] = { &mag, &alphaGlobal, &env1, &env2 };
+		evaluate([&](FrameTable::Quantity quantity, int i) {
+			return tables[quantity]->interpolate(i, tablePosition);
+		}, numSamplesAhead, alphaControl, amplitude, phase);
+	}
+
+	/** The same from a frame-major table. */
+	void evaluate(const FrameTable& table, double tablePosition, int numSamplesAhead, float alphaControl, float* amplitude, float* phase) const
+	{
+		evaluate([&](FrameTable::Quantity quantity, int i) {
+			return table.interpolate(quantity, i, tablePosition);
+		}, numSamplesAhead, alphaControl, amplitude, phase);
+	}
+
+	// carrier phase in cycles, wrapped to [-0.5, 0.5], and its per-sample increment
+	float* carrierPhase = nullptr;
+	float* carrierInc = nullptr;
+
+	// table values at the current frame and their slope per frame
+	float* magStart = nullptr;
+	float* magSlope = nullptr;
+	float* alphaGlobalStart = nullptr;
+	float* alphaGlobalSlope = nullptr;
+	float* env1Start = nullptr;
+	float* env1Slope = nullptr;
+	float* env2Start = nullptr;
+	float* env2Slope = nullptr;
+
+	// per-sample noise values
+	float* noise1 = nullptr;
+	float* noise2 = nullptr;
+
+	// per-block controls
+	float* magControl = nullptr;
+
+	// alphaLocal modulator phases in cycles, wrapped to [-0.5, 0.5], and their
+	// per-sample increments c * dt; a note starts them at -0.5
+	float* modPhase1 = nullptr;
+	float* modPhase2 = nullptr;
+	float* modInc1 = nullptr;
+	float* modInc2 = nullptr;
+
+	// per-note alphaLocal modulator parameters; gain includes alphaLocal.gain
+	float* modDepth1 = nullptr;
+	float* modDepth2 = nullptr;
+	float* modGain1 = nullptr;
+	float* modGain2 = nullptr;
+
+	// per-note bounds for the recurrence kernel: the largest |alphaLocal| at
+	// alphaControl 1 and the largest change of alphaGlobal per frame
+	float* alphaLocalBound = nullptr;
+	float* alphaGlobalRate = nullptr;
+
+	/** The largest rotation the recurrence kernel applies with its Taylor series. */
+	static constexpr float maxCorrectionAngle = 1.0f;
+
+private:
+	static constexpr int numArrays = 33;
+
+	// points the arrays into storage, `capacity` floats each
+	void assignArrays()
+	{
+		float* p = storage.get();
+		for (float** array : { &carrierPhase, &carrierInc, &magStart, &magSlope, &alphaGlobalStart, &alphaGlobalSlope,
+			&env1Start, &env1Slope, &env2Start, &env2Slope, &noise1, &noise2, &magControl,
+			&modPhase1, &modPhase2, &modInc1, &modInc2, &modDepth1, &modDepth2, &modGain1, &modGain2,
+			&alphaLocalBound, &alphaGlobalRate, &carrierRe, &carrierIm, &rotorRe, &rotorIm, &alphaAnchor,
+			&fade, &fadeTarget, &fadeEnd, &gainStart, &gainSlope }) {
+			*array = p;
+			p += capacity;
+		}
+	}
+
+	static constexpr float twoPi = 6.283185307179586f;
+	static constexpr double twoPiDouble = 6.283185307179586;
+
+	/** The largest magnitude of a partial between the loaded frame and the next, with its control. */
+	float getLevel(int i) const
+	{
+		return std::max(std::abs(magStart[i]), std::abs(magStart[i] + magSlope[i])) * std::abs(magControl[i]);
+	}
+
+	static void advance(float* phases, const float* increments, int count, int numSamples)
+	{
+		using namespace simd;
+
+		const Float vNumSamples = broadcast((float)numSamples);
+		for (int i = 0; i < count; i += width) {
+			// wrap the advance first so the sum keeps the precision of a small phase
+			const Float advance = wrapPhase(mul(load(increments + i), vNumSamples));
+			store(phases + i, wrapPhase(add(load(phases + i), advance)));
+		}
+	}
+
+	/** A phase `numSamples` increments on, wrapped. */
+	static float carrierAt(float phase, float increment, int numSamples)
+	{
+		const float advance = increment * numSamples;
+		const float wrapped = phase + (advance - std::nearbyint(advance));
+		return wrapped - std::nearbyint(wrapped);
+	}
+
+	/** alphaLocal of the partials at i at alphaControl 1; advances their modulators. */
+	simd::Float getAlphaLocal(int i, simd::Float vFrac)
+	{
+		using namespace simd;
+
+		const Float vTwoPi = broadcast(twoPi);
+		const Float mod1 = wrapPhase(add(load(modPhase1 + i), load(modInc1 + i)));
+		const Float mod2 = wrapPhase(add(load(modPhase2 + i), load(modInc2 + i)));
+		store(modPhase1 + i, mod1);
+		store(modPhase2 + i, mod2);
+		const Float s1 = simd::sin(mulAdd(vTwoPi, mod1, mul(load(modDepth1 + i), load(noise1 + i))));
+		const Float s2 = simd::sin(mulAdd(vTwoPi, mod2, mul(load(modDepth2 + i), load(noise2 + i))));
+
+		const Float env1 = mulAdd(load(env1Slope + i), vFrac, load(env1Start + i));
+		const Float env2 = mulAdd(load(env2Slope + i), vFrac, load(env2Start + i));
+		const Float alphaLocal = mul(mul(s1, env1), load(modGain1 + i));
+		return mulAdd(mul(s2, env2), load(modGain2 + i), alphaLocal);
+	}
+
+	// recurrence state: the current carrier e^{i (2 pi phase + alpha0)}, its
+	// per-sample rotor and alpha0
+	float* carrierRe = nullptr;
+	float* carrierIm = nullptr;
+	float* rotorRe = nullptr;
+	float* rotorIm = nullptr;
+	float* alphaAnchor = nullptr;
+
+	// culling: the fade at the block start, whether the partial should be
+	// audible, the fade at the block end and the resulting per-sample gain
+	// magControl * fade = gainStart + gainSlope * sample
+	float* fade = nullptr;
+	float* fadeTarget = nullptr;
+	float* fadeEnd = nullptr;
+	float* gainStart = nullptr;
+	float* gainSlope = nullptr;
+
+	// offsets of the vectors that hold an audible partial this block, and of the rest
+	std::vector<int> activeVectors;
+	std::vector<int> inactiveVectors;
+	// per quantity stored as breakpoints, each partial's segment; -1 until looked up
+	std::vector<int> segments;
+	int numActiveVectors = 0;
+	int numInactiveVectors = 0;
+	int blockSample = 0;
+	bool firstBlock = true;
+
+	void loadFrame(const LoopTable& table, int frame, float* start, float* slope)
+	{
+		for (int i = 0; i < numPartials; i++) {
+			const float* row = table.getPartial(i) + frame;
+			start[i] = row[0];
+			slope[i] = row[1] - row[0];
+		}
+	}
+
+	void loadFrame(const FrameTable& table, FrameTable::Quantity quantity, int frame, float* start, float* slope)
+	{
+		using namespace simd;
+		if (table.hasBreakpoints(quantity)) {
+			// padding lanes stay 0 from reset()
+			table.getBreakpoints(quantity).load(frame, segments.data() + (size_t)quantity * capacity, start, slope, numPartials);
+			return;
+		}
+		table.decode(frame, quantity, start, numPadded);
+		table.decode(frame + 1, quantity, slope, numPadded);
+		for (int i = 0; i < numPadded; i += width) {
+			store(slope + i, sub(load(slope + i), load(start + i)));
+		}
+	}
+
+	// `at(quantity, i)`: partial i's table value at the cursor
+	template <typename TableValue>
+	void evaluate(TableValue at, int numSamplesAhead, float alphaControl, float* amplitude, float* phase) const
+	{
+		for (int i = 0; i < numPartials; i++) {
+			if (fade[i] == 0 && fadeEnd[i] == 0) {
+				amplitude[i] = 0;
+				continue;
+			}
+			const float mod1 = carrierAt(modPhase1[i], modInc1[i], numSamplesAhead);
+			const float mod2 = carrierAt(modPhase2[i], modInc2[i], numSamplesAhead);
+			const float alphaLocal = std::sin(twoPi * mod1 + modDepth1[i] * noise1[i]) * at(FrameTable::env1, i) * modGain1[i]
+				+ std::sin(twoPi * mod2 + modDepth2[i] * noise2[i]) * at(FrameTable::env2, i) * modGain2[i];
+
+			amplitude[i] = at(FrameTable::mag, i) * magControl[i] * fadeEnd[i];
+			phase[i] = twoPi * carrierAt(carrierPhase[i], carrierInc[i], numSamplesAhead)
+				+ at(FrameTable::alphaGlobal, i) + alphaLocal * alphaControl;
+		}
+	}
+
+	AlignedBuffer storage;
+	int capacity = 0;
+	int numPartials = 0;
+	int numPadded = 0;
+};
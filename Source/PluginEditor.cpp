@@ -19,7 +19,8 @@ PhysicsBasedSynthAudioProcessorEditor::PhysicsBasedSynthAudioProcessorEditor (Ph
 		{"Attack", "attack"},
 		//{"Loop Start", "loopStart"},
 		//{"Loop End", "loopEnd"},
-		{"Input Channel", "inputChannel"}
+		{"Input Channel", "inputChannel"},
+		{"Polyphony", "polyphony"}
 		}),
 	featureParamComponent(p, "Feature", {
 		{"Intensity", "intensity"},
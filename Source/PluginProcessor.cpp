@@ -32,18 +32,113 @@ PhysicsBasedSynthAudioProcessor::PhysicsBasedSynthAudioProcessor()
 
     ,valueTree(*this, nullptr, "Parameters", createParameters())
 {
+    parameters.attach(valueTree);
+
+    // sized once, so that changing the polyphony never reallocates it
+    rankedVoices.reserve(MFMSynthesiser::maxNumVoices);
     mySynth.clearVoices();
+    setNumVoices((int)valueTree.getRawParameterValue("polyphony")->load());
+    valueTree.addParameterListener("polyphony", this);
+    updateRenderWorkers();
+    valueTree.addParameterListener("parallelRender", this);
+
+
+    mySynth.clearSounds();
+    mySynth.addSound(new SynthSound());
+
+    bankLoader.onBankLoaded = [this](std::shared_ptr<MFMBank> bank) { publishBank(std::move(bank)); };
+}
 
-    for (int i = 0; i < 10; i++)
+PhysicsBasedSynthAudioProcessor::~PhysicsBasedSynthAudioProcessor()
+{
+    valueTree.removeParameterListener("polyphony", this);
+    valueTree.removeParameterListener("parallelRender", this);
+    cancelPendingUpdate();
+}
+
+void PhysicsBasedSynthAudioProcessor::parameterChanged(const juce::String& parameterID, float newValue)
+{
+    // may be called on the audio thread
+    triggerAsyncUpdate();
+}
+
+void PhysicsBasedSynthAudioProcessor::handleAsyncUpdate()
+{
+    setNumVoices((int)valueTree.getRawParameterValue("polyphony")->load());
+    updateRenderWorkers();
+}
+
+void PhysicsBasedSynthAudioProcessor::updateRenderWorkers()
+{
+    const bool enabled = valueTree.getRawParameterValue("parallelRender")->load() > 0.5f;
+    if (enabled == (renderWorkers != nullptr))
+        return;
+
+    if (enabled)
+    {
+        // leave one core to the host's audio thread, which renders voices too;
+        // the threads start before the audio thread can see the pool
+        auto pool = std::make_unique<RenderWorkerPool>(juce::jlimit(0, 7, SystemStats::getNumCpus() - 1));
+        const ScopedLock sl(getCallbackLock());
+        renderWorkers = std::move(pool);
+        mySynth.setWorkerPool(renderWorkers.get());
+        return;
+    }
+
+    // the threads are stopped outside the lock, once the audio thread has let go
+    std::unique_ptr<RenderWorkerPool> pool;
+    {
+        const ScopedLock sl(getCallbackLock());
+        mySynth.setWorkerPool(nullptr);
+        pool = std::move(renderWorkers);
+    }
+}
+
+void PhysicsBasedSynthAudioProcessor::setNumVoices(int numVoices)
+{
+    numVoices = juce::jlimit(1, MFMSynthesiser::maxNumVoices, numVoices);
+    const bool prepared = getSampleRate() > 0;
+
+    // new voices are built, prepared and given their note state before the
+    // audio thread can see them; publishBank() grows the voices on this
+    // thread too, so this is the largest bank the audio thread may see
+    std::vector<SynthVoice*> newVoices;
+    for (int i = mySynth.getNumVoices(); i < numVoices; i++)
     {
         auto voice = new SynthVoice();
-        voice->setValueTree(valueTree);
-        mySynth.addVoice(voice);
+        voice->setParameters(parameters);
+        voice->setCurrentPlaybackSampleRate(getSampleRate());
+        if (prepared)
+            voice->prepareToPlay(&mfmControls, &channelToImage, currentNoteChannel);
+        voice->allocateNoteState(publishedMaxNumPartials);
+        newVoices.push_back(voice);
     }
+    auto scratch = MFMSynthesiser::makeScratch(prepared ? numVoices : 0, getTotalNumOutputChannels(), getBlockSize());
 
+    // under the lock voices are only linked in and out, which does not
+    // allocate (see MFMSynthesiser::maxNumVoices); removed voices and the
+    // old scratch buffers are freed after it
+    std::vector<std::unique_ptr<juce::SynthesiserVoice>> removed;
+    {
+        const ScopedLock sl(getCallbackLock());
+        for (auto voice : newVoices)
+        {
+            voice->setBank(audioBank);
+            mySynth.addVoice(voice);
+        }
 
-    mySynth.clearSounds();
-    mySynth.addSound(new SynthSound());
+        // drop idle voices first, then the most recently added
+        for (int i = mySynth.getNumVoices() - 1; i >= 0 && mySynth.getNumVoices() > numVoices; i--)
+        {
+            if (!mySynth.getVoice(i)->isVoiceActive())
+                removed.push_back(mySynth.takeVoice(i));
+        }
+        while (mySynth.getNumVoices() > numVoices)
+            removed.push_back(mySynth.takeVoice(mySynth.getNumVoices() - 1));
+
+        if (prepared)
+            mySynth.swapScratch(scratch);
+    }
 }
 
 
@@ -115,6 +210,8 @@ void PhysicsBasedSynthAudioProcessor::prepareToPlay (double sampleRate, int samp
     // Use this method as the place to do any pre-playback
     // initialisation that you need..
     mySynth.setCurrentPlaybackSampleRate(sampleRate);
+    renderGovernor.prepare(sampleRate);
+    mySynth.prepareScratch(getTotalNumOutputChannels(), samplesPerBlock);
 
  //   dsp::ProcessSpec spec;
  //   spec.sampleRate = sampleRate;
@@ -131,16 +228,6 @@ void PhysicsBasedSynthAudioProcessor::prepareToPlay (double sampleRate, int samp
  //   );
  //   dryBuffer.setSize(spec.numChannels, spec.maximumBlockSize);
 
-	for (int i = 0; i < mySynth.getNumVoices(); i++)
-	{
-		if (auto synthVoice = dynamic_cast<SynthVoice*>(mySynth.getVoice(i)))
-		{
-			synthVoice->prepareToPlay(&mfmParams, &mfmControls, &channelToImage, currentNoteChannel);
-		}
-	}
-
-
-
     auto dynamicControl = std::make_shared<MFMControl>(1);
 	dynamicControl->intensity[0] = 0.8;
 	dynamicControl->pitch[0] = 0;
@@ -151,17 +238,22 @@ void PhysicsBasedSynthAudioProcessor::prepareToPlay (double sampleRate, int samp
 	mfmControls["__dynamic__"] = dynamicControl;
 	channelToImage[1] = "__dynamic__";
 
-    auto tableDirectory = getState("TableDirectory");
-	if (tableDirectory.isNotEmpty())
+	for (int i = 0; i < mySynth.getNumVoices(); i++)
 	{
-		try {
-			loadMfmParamsFromFolder(tableDirectory);
-			triedLoadingTable = true;
-		}
-		catch (std::exception e) {
-			Logger::writeToLog("Error loading table directory: " + tableDirectory);
+		if (auto synthVoice = dynamic_cast<SynthVoice*>(mySynth.getVoice(i)))
+		{
+			synthVoice->prepareToPlay(&mfmControls, &channelToImage, currentNoteChannel);
 		}
 	}
+
+	// the bank's noise is generated at the output rate; a bank still loading
+	// is given the new rate when it is published
+	bankLoader.setSampleRate(sampleRate);
+	auto bank = banks.getCurrent();
+	if (bank != nullptr && bank->getSampleRate() != sampleRate)
+		publishBank(bank->withSampleRate(sampleRate));
+	else if (bank == nullptr && !bankLoader.getStatus().loading)
+		loadParams();
 }
 
 void PhysicsBasedSynthAudioProcessor::loadImages()
@@ -186,8 +278,65 @@ void PhysicsBasedSynthAudioProcessor::loadImages()
 
 void PhysicsBasedSynthAudioProcessor::loadParams()
 {
+	updateFillMode();
+
+	// MB of note tables an on-demand bank may keep loaded, 0 or empty for no limit
+	bankLoader.setMemoryBudget((size_t)juce::jmax(0, getState("MemoryBudgetMB").getIntValue()) * 1024 * 1024);
+
 	auto tableDirectory = getState("TableDirectory");
-    loadMfmParamsFromFolder(tableDirectory);
+	if (tableDirectory.isNotEmpty())
+		bankLoader.load(tableDirectory, getSampleRate(), getState("LoadNotesOnDemand") == "1");
+}
+
+void PhysicsBasedSynthAudioProcessor::publishBank(std::shared_ptr<MFMBank> bank)
+{
+	// the loader may have started before the sample rate was known or changed
+	if (getSampleRate() > 0 && bank->getSampleRate() != getSampleRate())
+		bank = bank->withSampleRate(getSampleRate());
+
+	if (bank->getMaxNumPartials() > publishedMaxNumPartials)
+	{
+		// the larger buffers are allocated here; under the lock the voices
+		// only take them over, copying the state of the notes playing
+		std::vector<std::unique_ptr<SynthVoice::NoteState>> states;
+		for (int i = 0; i < mySynth.getNumVoices(); i++)
+			states.push_back(std::make_unique<SynthVoice::NoteState>(bank->getMaxNumPartials()));
+
+		{
+			const ScopedLock sl(getCallbackLock());
+			publishedMaxNumPartials = bank->getMaxNumPartials();
+			for (int i = 0; i < mySynth.getNumVoices(); i++)
+			{
+				if (auto synthVoice = dynamic_cast<SynthVoice*>(mySynth.getVoice(i)))
+					synthVoice->growNoteState(*states[(size_t)i]);
+			}
+		}
+		// the old buffers are freed with `states`, outside the lock
+	}
+
+	// the replaced bank is freed by bankReclaimer
+	banks.publish(std::move(bank));
+}
+
+void PhysicsBasedSynthAudioProcessor::updateFillMode()
+{
+	const auto mode = getState("FillMissingNotes");
+	bankLoader.setFillMode(mode == "interpolate" ? MFMBank::FillMode::interpolate
+		: mode == "nearest" ? MFMBank::FillMode::nearest : MFMBank::FillMode::none);
+}
+
+MFMBank::Footprint PhysicsBasedSynthAudioProcessor::getMemoryFootprint()
+{
+	auto bank = banks.getCurrent();
+	auto footprint = bank != nullptr ? bank->getFootprint() : MFMBank::Footprint();
+	// voices are only resized on this thread
+	for (int i = 0; i < mySynth.getNumVoices(); i++)
+	{
+		if (auto synthVoice = dynamic_cast<SynthVoice*>(mySynth.getVoice(i)))
+			footprint.voices.push_back(synthVoice->getMemoryBytes());
+	}
+	footprint.budget = (size_t)juce::jmax(0, getState("MemoryBudgetMB").getIntValue()) * 1024 * 1024;
+	return footprint;
 }
 
 void PhysicsBasedSynthAudioProcessor::startNetworkThread()
@@ -207,6 +356,15 @@ void PhysicsBasedSynthAudioProcessor::releaseResources()
 {
     // When playback stops, you can use this as an opportunity to free up any
     // spare memory, etc.
+
+    // silence the voices, so that the banks and notes they held can be freed
+    // or unloaded before playback resumes
+    {
+        const ScopedLock sl(getCallbackLock());
+        mySynth.allNotesOff(0, false);
+        banks.endPlayback();
+    }
+    bankLoader.endPlayback();
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -235,31 +393,23 @@ bool PhysicsBasedSynthAudioProcessor::isBusesLayoutSupported (const BusesLayout&
 }
 #endif
 
-void setParam(AudioProcessorValueTreeState& valueTree, String paramId, float value)
-{
-	//valueTree.getParameter(paramId)->beginChangeGesture();
-	valueTree.getParameter(paramId)->setValueNotifyingHost(value);
-	//valueTree.getParameter(paramId)->endChangeGesture();
-}
-
 void PhysicsBasedSynthAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
-	if (!triedLoadingTable)
-	{
-        auto tableDirectory = getState("TableDirectory");
-        if (tableDirectory.isNotEmpty() ){
-
-            try {
-                loadMfmParamsFromFolder(tableDirectory);
-			}
-			catch (std::exception e) {
-				Logger::writeToLog("Error loading table directory: " + tableDirectory);
-			}
-
-            triedLoadingTable = true;
+    // new notes come from the latest published bank; notes already sounding
+    // finish on the bank they started with
+    const MFMBank* bank = banks.acquire();
+    if (bank != audioBank)
+    {
+        audioBank = bank;
+        for (int i = 0; i < mySynth.getNumVoices(); i++)
+        {
+            if (auto synthVoice = dynamic_cast<SynthVoice*>(mySynth.getVoice(i)))
+                synthVoice->setBank(audioBank);
         }
-	}
+    }
+
     juce::ScopedNoDenormals noDenormals;
+    parameters.update();
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
 
@@ -277,7 +427,7 @@ void PhysicsBasedSynthAudioProcessor::processBlock (juce::AudioBuffer<float>& bu
 	MidiBuffer::Iterator it(midiMessages);
 	MidiMessage message;
 	MidiBuffer filteredMidiMessages;
-	int currentChannel = valueTree.getRawParameterValue("inputChannel")->load();
+	int currentChannel = (int)parameters[ParameterSnapshot::inputChannel];
 	int sampleNumber;
     while (it.getNextEvent(message, sampleNumber)) {
 
@@ -298,6 +448,8 @@ void PhysicsBasedSynthAudioProcessor::processBlock (juce::AudioBuffer<float>& bu
             const int midiChannel = message.getChannel();
             const int midiNote = message.getNoteNumber();
 			currentNoteChannel[midiNote] = midiChannel;
+			// an on-demand bank starts loading the note and its neighbours
+			bankLoader.requestNote(midiNote);
         }
         
 		// control change 11, 75-79 are used for MFM
@@ -309,31 +461,31 @@ void PhysicsBasedSynthAudioProcessor::processBlock (juce::AudioBuffer<float>& bu
 			case 11: // expression
                 control->intensity[0] = value / 127.0;
 				
-				setParam(valueTree, "intensity", value / 127.0);
+				parameters.setNormalised(ParameterSnapshot::intensity, value / 127.0);
                 break;
             case 75:
                 control->density[0] = value / 127.0 - 0.5;
                 
-				setParam(valueTree, "roughness", value / 127.0);
+				parameters.setNormalised(ParameterSnapshot::roughness, value / 127.0);
                 break;
             case 76:
                 control->pitch[0] = value / 127.0;
-				setParam(valueTree, "vibrato", value / 127.0);
+				parameters.setNormalised(ParameterSnapshot::vibrato, value / 127.0);
                 break;
             case 77:
                 control->hue[0] = value / 127.0 * 140;
                 
-				setParam(valueTree, "bowPosition", value / 127.0);
+				parameters.setNormalised(ParameterSnapshot::bowPosition, value / 127.0);
                 break;
             case 78:
                 control->saturation[0] = value / 127.0;
                 
-				setParam(valueTree, "resonance", value / 127.0);
+				parameters.setNormalised(ParameterSnapshot::resonance, value / 127.0);
                 break;
             case 79:
                 control->value[0] = value / 127.0;
 				
-				setParam(valueTree, "sharpness", value / 127.0);
+				parameters.setNormalised(ParameterSnapshot::sharpness, value / 127.0);
                 break;
             }
         }
@@ -341,7 +493,34 @@ void PhysicsBasedSynthAudioProcessor::processBlock (juce::AudioBuffer<float>& bu
 
 
 
+    applyRenderDetail();
+    mySynth.setParallelRendering(parameters[ParameterSnapshot::parallelRender] > 0.5f);
+    renderGovernor.setDirectKernelInUse((int)parameters[ParameterSnapshot::oscillator] == SynthVoice::direct);
+    renderGovernor.beginBlock();
     mySynth.renderNextBlock(buffer, filteredMidiMessages, 0, buffer.getNumSamples());
+    renderGovernor.endBlock(buffer.getNumSamples());
+
+    // tell the message thread which banks it may free, and the loader which
+    // notes it must keep
+    // (the acquired bank is accounted for by the publisher)
+    juce::uint64 oldestBank = BankPublisher::noneInUse;
+    std::array<bool, BankLoader::numNotes> soundingNotes = {};
+    for (int i = 0; i < mySynth.getNumVoices(); i++)
+    {
+        if (auto synthVoice = dynamic_cast<SynthVoice*>(mySynth.getVoice(i)))
+        {
+            if (auto noteBank = synthVoice->getNoteBank())
+            {
+                oldestBank = std::min(oldestBank, noteBank->getGeneration());
+                // the note whose table it plays, which may be a neighbour of
+                // the note played while that one loads
+                if (juce::isPositiveAndBelow(synthVoice->getParamNote(), BankLoader::numNotes))
+                    soundingNotes[synthVoice->getParamNote()] = true;
+            }
+        }
+    }
+    banks.endBlock(oldestBank);
+    bankLoader.setSoundingNotes(soundingNotes);
     // dry signal
     
  //   dryBuffer.makeCopyOf(buffer, true);
@@ -362,6 +541,30 @@ void PhysicsBasedSynthAudioProcessor::processBlock (juce::AudioBuffer<float>& bu
 	//context.getOutputBlock().add<float>(dryBuffer);
 }
 
+void PhysicsBasedSynthAudioProcessor::applyRenderDetail()
+{
+	// the quieter half of the playing voices gives up detail first
+	rankedVoices.clear();
+	for (int i = 0; i < mySynth.getNumVoices(); i++)
+	{
+		if (auto synthVoice = dynamic_cast<SynthVoice*>(mySynth.getVoice(i)))
+		{
+			if (synthVoice->isVoiceActive())
+				rankedVoices.push_back(synthVoice);
+			else
+				synthVoice->setRenderDetail(renderGovernor.getPartialSteps(false), renderGovernor.useCheapOscillator());
+		}
+	}
+	std::sort(rankedVoices.begin(), rankedVoices.end(), [](SynthVoice* a, SynthVoice* b) {
+		return a->getOutputLevel() < b->getOutputLevel();
+	});
+	for (size_t i = 0; i < rankedVoices.size(); i++)
+	{
+		const bool quieterHalf = i < rankedVoices.size() / 2;
+		rankedVoices[i]->setRenderDetail(renderGovernor.getPartialSteps(quieterHalf), renderGovernor.useCheapOscillator());
+	}
+}
+
 //==============================================================================
 bool PhysicsBasedSynthAudioProcessor::hasEditor() const
 {
@@ -399,20 +602,11 @@ void PhysicsBasedSynthAudioProcessor::setStateInformation (const void* data, int
     if (xmlState.get() != nullptr)
         if (xmlState->hasTagName(valueTree.state.getType()))
             valueTree.replaceState(juce::ValueTree::fromXml(*xmlState));
-}
 
-void PhysicsBasedSynthAudioProcessor::loadMfmParamsFromFolder(juce::String path)
-{
-	mfmParams.clear();
-	for (const auto& entry : std::filesystem::directory_iterator(path.toStdString()))
-	{
-		if (entry.path().extension() == ".npz")
-		{
-			mfmParams[std::stoi(entry.path().stem().string())] = std::make_unique<MFMParam>(entry.path().string());
-		}
-		juce::Logger::writeToLog("Loaded MFM params from " + path);
-	}
-    
+    // the restored state may point at another table directory
+    auto bank = banks.getCurrent();
+    if (bank == nullptr || bank->getDirectory() != getState("TableDirectory"))
+        loadParams();
 }
 
 //==============================================================================
@@ -434,6 +628,11 @@ AudioProcessorValueTreeState::ParameterLayout PhysicsBasedSynthAudioProcessor::c
 	params.push_back(std::make_unique<AudioParameterFloat>("loopStart", "Loop Start", 0.0f, 5.0f, 0.5f));
     params.push_back(std::make_unique<AudioParameterFloat>("loopEnd", "Loop End", 0.0f, 5.0f, 1.0f));
 	params.push_back(std::make_unique<AudioParameterInt>("inputChannel", "Input Channel", 0, 16, 0));
+	params.push_back(std::make_unique<AudioParameterInt>("polyphony", "Polyphony", 1, MFMSynthesiser::maxNumVoices, 10));
+	// how the voices render their carriers, see SynthVoice::OscillatorMode
+	params.push_back(std::make_unique<AudioParameterChoice>("oscillator", "Oscillator", StringArray{ "Direct", "Recurrence", "Spectral" }, 1));
+	// render the voices on several cores, see MFMSynthesiser::renderVoices
+	params.push_back(std::make_unique<AudioParameterBool>("parallelRender", "Parallel Rendering", false));
 
 	// feature parameters
 	params.push_back(std::make_unique<AudioParameterFloat>("intensity", "Intensity", 0.0f, 1.0f, 0.5f));
@@ -13,6 +13,11 @@
 #include "SynthSound.h"
 #include "MFMParam.h"
 #include "MFMControl.h"
+#include "ParameterSnapshot.h"
+#include "RenderGovernor.h"
+#include "MFMSynthesiser.h"
+#include "MFMBank.h"
+#include "BankLoader.h"
 class PhysicsBasedSynthAudioProcessor;
 class NetworkThread : public juce::Thread
 {
@@ -33,11 +38,14 @@ public:
 //==============================================================================
 /**
 */
-class PhysicsBasedSynthAudioProcessor  : public juce::AudioProcessor
+class PhysicsBasedSynthAudioProcessor  : public juce::AudioProcessor,
+                                          private juce::AudioProcessorValueTreeState::Listener,
+                                          private juce::AsyncUpdater
 {
 public: 
     //==============================================================================
     PhysicsBasedSynthAudioProcessor();
+    ~PhysicsBasedSynthAudioProcessor() override;
 
     //==============================================================================
     void prepareToPlay (double sampleRate, int samplesPerBlock) override;
@@ -73,6 +81,7 @@ public:
     void setStateInformation (const void* data, int sizeInBytes) override;
 
     juce::AudioProcessorValueTreeState valueTree;
+    ParameterSnapshot parameters;
 
     void addNotation(juce::String name, juce::File image);
 
@@ -82,11 +91,16 @@ public:
 	std::map<int, juce::String> channelToImage;
 
 
-    std::map<int, std::shared_ptr<MFMParam>> mfmParams;
     std::map<juce::String, std::shared_ptr<MFMControl>> mfmControls;
 
 	void loadImages();
+	// loads the TableDirectory in the background, see getBankLoadStatus()
 	void loadParams();
+	// applies the FillMissingNotes state ("nearest" or "interpolate") to the current and next banks
+	void updateFillMode();
+	BankLoader::Status getBankLoadStatus() const { return bankLoader.getStatus(); }
+	// the memory of the current bank and of the voices; message thread
+	MFMBank::Footprint getMemoryFootprint();
 	void startNetworkThread();
 
     void setState(juce::String name, juce::String value);
@@ -96,9 +110,16 @@ public:
 
 	juce::String lastMidiMessage;
 
+	// the render governor's state, for the editor
+	int getRenderDetailLevel() const { return renderGovernor.getLevel(); }
+	float getRenderLoad() const { return renderGovernor.getLoad(); }
+
 
 private:
-    juce::Synthesiser mySynth;
+	// declared first so that it outlives the synthesiser using it; null
+	// while parallel rendering is off, see updateRenderWorkers()
+	std::unique_ptr<RenderWorkerPool> renderWorkers;
+    MFMSynthesiser mySynth;
 
     juce::dsp::Convolution convolution;
     juce::AudioBuffer<float> dryBuffer; 
@@ -110,9 +131,28 @@ private:
 
     int currentNoteChannel[128] = { 1 };
 
-	void loadMfmParamsFromFolder(juce::String path);
-
-	bool triedLoadingTable = false;
+	// the note tables; published on the message thread, read by the audio
+	// thread through audioBank
+	BankPublisher banks;
+	BankReclaimer bankReclaimer{ banks };
+	const MFMBank* audioBank = nullptr;
+	int publishedMaxNumPartials = 1;
+	void publishBank(std::shared_ptr<MFMBank> bank);
+
+	// the voice pool follows the "polyphony" parameter and the render workers
+	// the "parallelRender" one; both are updated on the message thread
+	void parameterChanged(const juce::String& parameterID, float newValue) override;
+	void handleAsyncUpdate() override;
+	void setNumVoices(int numVoices);
+	// starts the render workers when parallel rendering is switched on and stops them when it is switched off
+	void updateRenderWorkers();
+
+	RenderGovernor renderGovernor;
+	std::vector<SynthVoice*> rankedVoices;
+	void applyRenderDetail();
+
+	// declared last so that its thread stops before anything it publishes to goes away
+	BankLoader bankLoader;
 
 
     //==============================================================================
@@ -0,0 +1,46 @@
+/*
+  ==============================================================================
+
+    RealtimeCheck.cpp
+    Created: 16 Oct 2026 3:20:18pm
+    Author:  a931e
+
+  ==============================================================================
+*/
+
+#include "RealtimeCheck.h"
+
+#if MFM_CHECK_REALTIME_ALLOCATIONS && JUCE_DEBUG
+#include <cstdlib>
+#include <new>
+
+void ScopedNoAllocation::reportAllocation()
+{
+	// the assertion handler may allocate itself
+	const int saved = depth();
+	depth() = 0;
+	jassertfalse; // allocation inside a ScopedNoAllocation, i.e. on the audio thread
+	depth() = saved;
+}
+
+void* operator new(std::size_t size)
+{
+	if (ScopedNoAllocation::isActive()) {
+		ScopedNoAllocation::reportAllocation();
+	}
+	if (void* p = std::malloc(size == 0 ? 1 : size)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+#endif
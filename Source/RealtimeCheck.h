@@ -0,0 +1,57 @@
+/*
+  ==============================================================================
+
+    RealtimeCheck.h
+    Created: 16 Oct 2026 3:20:18pm
+    Author:  a931e
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/*
+ * Debug-only check that code on the audio thread does not allocate.
+ *
+ * Build with MFM_CHECK_REALTIME_ALLOCATIONS=1 (e.g. in the Projucer's
+ * preprocessor definitions of the Debug configuration) to replace the global
+ * operator new; any allocation on a thread that is inside a
+ * ScopedNoAllocation then hits a jassert. Otherwise ScopedNoAllocation
+ * compiles to nothing.
+ */
+#ifndef MFM_CHECK_REALTIME_ALLOCATIONS
+ #define MFM_CHECK_REALTIME_ALLOCATIONS 0
+#endif
+
+#if MFM_CHECK_REALTIME_ALLOCATIONS && JUCE_DEBUG
+class ScopedNoAllocation
+{
+public:
+	ScopedNoAllocation() { ++depth(); }
+	~ScopedNoAllocation() { --depth(); }
+
+	ScopedNoAllocation(const ScopedNoAllocation&) = delete;
+	ScopedNoAllocation& operator=(const ScopedNoAllocation&) = delete;
+
+	static bool isActive() { return depth() > 0; }
+
+	// called by operator new when isActive()
+	static void reportAllocation();
+
+private:
+	static int& depth()
+	{
+		thread_local int value = 0;
+		return value;
+	}
+};
+#else
+class ScopedNoAllocation
+{
+public:
+	ScopedNoAllocation() {}
+	static bool isActive() { return false; }
+};
+#endif
@@ -0,0 +1,128 @@
+/*
+  ==============================================================================
+
+    RenderGovernor.h
+    Created: 16 Oct 2026 8:47:12pm
+    Author:  a931e
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+
+/*
+ * Keeps the synth's render time within a share of the block deadline by
+ * trading detail for time. The processor times every render with
+ * beginBlock() / endBlock() and applies the resulting level of detail to its
+ * voices:
+ *
+ *   level 0     everything as configured
+ *   level 1     voices using the direct kernel switch to the recurrence kernel;
+ *               skipped while no voice uses it, see setDirectKernelInUse()
+ *   level l > 1 the quieter half of the voices render at most 1/2^(l-1) of
+ *               their partials, the louder half 1/2^(l-2), never fewer than
+ *               SynthVoice::minRenderedPartials
+ *
+ * A block over the target share raises the level, after which the governor
+ * waits a few blocks to see the effect before raising it again. The level is
+ * lowered one step at a time once the load has stayed below the recovery
+ * share for recoveryTime.
+ */
+class RenderGovernor
+{
+public:
+	static constexpr int maxLevel = 6;
+
+	void prepare(double sampleRate)
+	{
+		this->sampleRate = sampleRate;
+		level = 0;
+		load = 0;
+		holdBlocks = 0;
+		timeBelowRecovery = 0;
+	}
+
+	/**
+	 * Whether the voices use the direct kernel; if not, level 1 would cost
+	 * nothing less than level 0, so the level goes from 0 to 2 and back.
+	 */
+	void setDirectKernelInUse(bool inUse)
+	{
+		directKernelInUse = inUse;
+	}
+
+	void beginBlock()
+	{
+		startTicks = juce::Time::getHighResolutionTicks();
+	}
+
+	void endBlock(int numSamples)
+	{
+		if (numSamples <= 0) {
+			return;
+		}
+		const double elapsed = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+		const double deadline = numSamples / sampleRate;
+		const float blockLoad = (float)(elapsed / deadline);
+		load = blockLoad;
+
+		int newLevel = level;
+		if (holdBlocks > 0) {
+			holdBlocks--;
+		}
+		else if (blockLoad > targetShare && newLevel < maxLevel) {
+			newLevel++;
+			if (newLevel == 1 && !directKernelInUse) {
+				newLevel++;
+			}
+			holdBlocks = settleBlocks;
+		}
+
+		if (blockLoad < recoveryShare) {
+			timeBelowRecovery += deadline;
+			if (timeBelowRecovery >= recoveryTime && newLevel > 0) {
+				newLevel--;
+				if (newLevel == 1 && !directKernelInUse) {
+					newLevel--;
+				}
+				timeBelowRecovery = 0;
+			}
+		}
+		else {
+			timeBelowRecovery = 0;
+		}
+		level = newLevel;
+	}
+
+	/** The current level of detail, 0 being full detail; safe to read from any thread. */
+	int getLevel() const { return level; }
+
+	/** The share of the deadline the last block took; safe to read from any thread. */
+	float getLoad() const { return load; }
+
+	bool useCheapOscillator() const { return level >= 1; }
+
+	/** How many times a voice halves its partial count at the current level. */
+	int getPartialSteps(bool quieterHalf) const
+	{
+		const int l = level;
+		return std::max(0, quieterHalf ? l - 1 : l - 2);
+	}
+
+private:
+	static constexpr float targetShare = 0.75f;
+	static constexpr float recoveryShare = 0.4f;
+	static constexpr double recoveryTime = 1.0;
+	static constexpr int settleBlocks = 4;
+
+	double sampleRate = 44100;
+	juce::int64 startTicks = 0;
+	std::atomic<int> level{ 0 };
+	std::atomic<float> load{ 0 };
+	bool directKernelInUse = true;
+	int holdBlocks = 0;
+	double timeBelowRecovery = 0;
+};
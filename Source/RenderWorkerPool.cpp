@@ -0,0 +1,186 @@
+/*
+  ==============================================================================
+
+    RenderWorkerPool.cpp
+    Created: 16 Oct 2026 11:14:03pm
+    Author:  a931e
+
+  ==============================================================================
+*/
+
+#include "RenderWorkerPool.h"
+
+#if JUCE_WINDOWS
+ #define NOMINMAX
+ #include <windows.h>
+#elif JUCE_MAC || JUCE_IOS
+ #include <dispatch/dispatch.h>
+#else
+ #include <semaphore.h>
+#endif
+
+#if JUCE_INTEL
+ #include <immintrin.h>
+#endif
+
+namespace
+{
+	// tells the core we are busy-waiting
+	inline void spinPause()
+	{
+#if JUCE_INTEL
+		_mm_pause();
+#elif JUCE_ARM && (JUCE_MAC || JUCE_IOS || defined(__aarch64__))
+		__asm__ __volatile__("yield");
+#endif
+	}
+}
+
+//==============================================================================
+RenderSemaphore::RenderSemaphore()
+{
+#if JUCE_WINDOWS
+	handle = CreateSemaphoreW(nullptr, 0, LONG_MAX, nullptr);
+#elif JUCE_MAC || JUCE_IOS
+	handle = dispatch_semaphore_create(0);
+#else
+	auto semaphore = new sem_t;
+	sem_init(semaphore, 0, 0);
+	handle = semaphore;
+#endif
+}
+
+RenderSemaphore::~RenderSemaphore()
+{
+#if JUCE_WINDOWS
+	CloseHandle(handle);
+#elif JUCE_MAC || JUCE_IOS
+	dispatch_release((dispatch_semaphore_t)handle);
+#else
+	sem_destroy((sem_t*)handle);
+	delete (sem_t*)handle;
+#endif
+}
+
+void RenderSemaphore::signal(int count)
+{
+	if (count <= 0) {
+		return;
+	}
+#if JUCE_WINDOWS
+	ReleaseSemaphore(handle, count, nullptr);
+#elif JUCE_MAC || JUCE_IOS
+	for (int i = 0; i < count; i++) {
+		dispatch_semaphore_signal((dispatch_semaphore_t)handle);
+	}
+#else
+	for (int i = 0; i < count; i++) {
+		sem_post((sem_t*)handle);
+	}
+#endif
+}
+
+void RenderSemaphore::wait()
+{
+#if JUCE_WINDOWS
+	WaitForSingleObject(handle, INFINITE);
+#elif JUCE_MAC || JUCE_IOS
+	dispatch_semaphore_wait((dispatch_semaphore_t)handle, DISPATCH_TIME_FOREVER);
+#else
+	while (sem_wait((sem_t*)handle) != 0) {
+		// interrupted by a signal
+	}
+#endif
+}
+
+//==============================================================================
+class RenderWorkerPool::Worker : public juce::Thread
+{
+public:
+	Worker(RenderWorkerPool& pool, int core)
+		: juce::Thread("MFM render worker"), pool(pool), core(core)
+	{
+	}
+
+	void run() override
+	{
+		// keep each worker on its own core, away from core 0 where hosts
+		// usually run their audio thread
+		juce::Thread::setCurrentThreadAffinityMask((juce::uint32)1 << core);
+		juce::ScopedNoDenormals noDenormals;
+
+		for (;;) {
+			pool.wakeUp.wait();
+			if (threadShouldExit()) {
+				return;
+			}
+			pool.runJobs();
+		}
+	}
+
+private:
+	RenderWorkerPool& pool;
+	const int core;
+};
+
+//==============================================================================
+RenderWorkerPool::RenderWorkerPool(int numWorkers)
+{
+	const int numCores = juce::jmin(juce::SystemStats::getNumCpus(), 32);
+	for (int i = 0; i < numWorkers; i++) {
+		workers.push_back(std::make_unique<Worker>(*this, (i + 1) % numCores));
+#if JUCE_MAJOR_VERSION >= 7
+		workers.back()->startRealtimeThread(juce::Thread::RealtimeOptions{});
+#else
+		workers.back()->startThread(10);
+#endif
+	}
+}
+
+RenderWorkerPool::~RenderWorkerPool()
+{
+	for (auto& worker : workers) {
+		worker->signalThreadShouldExit();
+	}
+	wakeUp.signal((int)workers.size());
+	for (auto& worker : workers) {
+		worker->stopThread(1000);
+	}
+}
+
+void RenderWorkerPool::run(Task& task, int numJobs)
+{
+	jassert(numJobs <= maxJobs);
+	numJobs = juce::jmin(numJobs, maxJobs);
+
+	this->task = &task;
+	completed.store(0, std::memory_order_relaxed);
+	generation++;
+	claim.store((juce::uint64)generation << 32 | (juce::uint64)numJobs << 16, std::memory_order_release);
+
+	// the calling thread takes jobs too, so one worker fewer is enough
+	wakeUp.signal(juce::jmin(getNumWorkers(), numJobs - 1));
+	runJobs();
+
+	while (completed.load(std::memory_order_acquire) < numJobs) {
+		spinPause();
+	}
+}
+
+void RenderWorkerPool::runJobs()
+{
+	juce::uint64 current = claim.load(std::memory_order_acquire);
+	for (;;) {
+		const int numJobs = (int)((current >> 16) & 0xffff);
+		const int index = (int)(current & 0xffff);
+		if (index >= numJobs) {
+			return;
+		}
+		// on failure current is reloaded and we try the next free job
+		if (claim.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+			task->run(index);
+			completed.fetch_add(1, std::memory_order_release);
+			current = claim.load(std::memory_order_acquire);
+		}
+	}
+}
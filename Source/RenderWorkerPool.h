@@ -0,0 +1,79 @@
+/*
+  ==============================================================================
+
+    RenderWorkerPool.h
+    Created: 16 Oct 2026 11:14:03pm
+    Author:  a931e
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+/*
+ * A counting semaphore on the OS primitive (futex-backed on Linux, a kernel
+ * semaphore on Windows, libdispatch on macOS). Unlike juce::WaitableEvent,
+ * signal() never takes a mutex, so the audio thread may call it.
+ */
+class RenderSemaphore
+{
+public:
+	RenderSemaphore();
+	~RenderSemaphore();
+
+	RenderSemaphore(const RenderSemaphore&) = delete;
+	RenderSemaphore& operator=(const RenderSemaphore&) = delete;
+
+	void signal(int count);
+	void wait();
+
+private:
+	void* handle = nullptr;
+};
+
+/*
+ * A few pinned, high-priority threads that help the audio thread through a
+ * list of independent jobs. run() hands the jobs over without locks: the
+ * next job index, the job count and a generation live in one atomic word
+ * that every thread claims jobs from with compare-and-swap, so a worker that
+ * wakes late can never claim a job of a newer run with stale data. The
+ * calling thread works on the jobs too and then spins until all are done.
+ */
+class RenderWorkerPool
+{
+public:
+	struct Task
+	{
+		virtual ~Task() {}
+		virtual void run(int jobIndex) = 0;
+	};
+
+	explicit RenderWorkerPool(int numWorkers);
+	~RenderWorkerPool();
+
+	int getNumWorkers() const { return (int)workers.size(); }
+
+	/** Runs task.run(0 .. numJobs - 1) on the workers and the calling thread; returns when all are done. */
+	void run(Task& task, int numJobs);
+
+private:
+	class Worker;
+
+	void runJobs();
+
+	static constexpr int maxJobs = 0xffff;
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	RenderSemaphore wakeUp;
+
+	// generation << 32 | numJobs << 16 | next job index
+	std::atomic<juce::uint64> claim{ 0 };
+	std::atomic<int> completed{ 0 };
+	juce::uint32 generation = 0;
+	Task* task = nullptr;
+};
@@ -0,0 +1,302 @@
+/*
+  ==============================================================================
+
+    SIMD.h
+    Created: 16 Oct 2026 10:12:31am
+    Author:  a931e
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#if defined(_MSC_VER)
+ #include <malloc.h>
+#endif
+
+// Pick the widest instruction set the compiler is allowed to emit. Build with
+// /arch:AVX512, /arch:AVX2, -mavx512f or -mavx2 -mfma to get the wider paths;
+// x64 always has at least SSE2.
+#if defined(__AVX512F__)
+ #include <immintrin.h>
+ #define MFM_SIMD_AVX512 1
+#elif defined(__AVX2__)
+ #include <immintrin.h>
+ #define MFM_SIMD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+ #include <emmintrin.h>
+ #define MFM_SIMD_SSE2 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+ #include <arm_neon.h>
+ #define MFM_SIMD_NEON 1
+#endif
+
+/*
+ * Thin wrapper over the native float vector of the target, so kernels can be
+ * written once and compiled to 16 (AVX-512), 8 (AVX2), 4 (SSE2 / NEON) or
+ * 1 (plain C++) lanes. All loads and stores are aligned.
+ *
+ * loadHalf() and loadInt16() widen `width` 16-bit values to a vector, with
+ * the F16C / NEON conversions where the target has them.
+ */
+namespace simd
+{
+	/** IEEE half precision to float, exactly. */
+	inline float halfToFloat(uint16_t half)
+	{
+		const uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+		const uint32_t exponent = (half >> 10) & 0x1f;
+		uint32_t mantissa = half & 0x3ff;
+		uint32_t bits;
+		if (exponent == 0x1f) {
+			bits = sign | 0x7f800000 | (mantissa << 13);
+		}
+		else if (exponent != 0) {
+			bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+		}
+		else if (mantissa == 0) {
+			bits = sign;
+		}
+		else {
+			// subnormal: normalise
+			uint32_t shift = 0;
+			while ((mantissa & 0x400) == 0) {
+				mantissa <<= 1;
+				shift++;
+			}
+			bits = sign | ((113 - shift) << 23) | ((mantissa & 0x3ff) << 13);
+		}
+		float value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	/** Float to the nearest half, ties to even; beyond the half range clamps to the largest finite half. */
+	inline uint16_t floatToHalf(float value)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		const uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+		const float magnitude = std::fmin(std::fabs(value), 65504.0f);
+		if (magnitude < 6.103515625e-05f) {
+			// zero or subnormal: a multiple of 2^-24
+			return (uint16_t)(sign | (uint16_t)std::nearbyint(magnitude * 16777216.0f));
+		}
+		std::memcpy(&bits, &magnitude, sizeof(bits));
+		bits += 0xfff + ((bits >> 13) & 1);
+		return (uint16_t)(sign | ((bits >> 13) - (112 << 10)));
+	}
+
+#if MFM_SIMD_AVX512
+	using Float = __m512;
+	constexpr int width = 16;
+
+	inline Float load(const float* p) { return _mm512_load_ps(p); }
+	inline void store(float* p, Float a) { _mm512_store_ps(p, a); }
+	inline Float broadcast(float a) { return _mm512_set1_ps(a); }
+	inline Float add(Float a, Float b) { return _mm512_add_ps(a, b); }
+	inline Float sub(Float a, Float b) { return _mm512_sub_ps(a, b); }
+	inline Float mul(Float a, Float b) { return _mm512_mul_ps(a, b); }
+	inline Float div(Float a, Float b) { return _mm512_div_ps(a, b); }
+	inline Float mulAdd(Float a, Float b, Float c) { return _mm512_fmadd_ps(a, b, c); }
+	inline Float roundNearest(Float a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+	inline float sum(Float a) { return _mm512_reduce_add_ps(a); }
+	inline Float loadHalf(const uint16_t* p) { return _mm512_cvtph_ps(_mm256_load_si256(reinterpret_cast<const __m256i*>(p))); }
+	inline Float loadInt16(const int16_t* p) { return _mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(_mm256_load_si256(reinterpret_cast<const __m256i*>(p)))); }
+#elif MFM_SIMD_AVX2
+	using Float = __m256;
+	constexpr int width = 8;
+
+	inline Float load(const float* p) { return _mm256_load_ps(p); }
+	inline void store(float* p, Float a) { _mm256_store_ps(p, a); }
+	inline Float broadcast(float a) { return _mm256_set1_ps(a); }
+	inline Float add(Float a, Float b) { return _mm256_add_ps(a, b); }
+	inline Float sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+	inline Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+	inline Float div(Float a, Float b) { return _mm256_div_ps(a, b); }
+  #if defined(__FMA__) || defined(_MSC_VER)
+	inline Float mulAdd(Float a, Float b, Float c) { return _mm256_fmadd_ps(a, b, c); }
+  #else
+	inline Float mulAdd(Float a, Float b, Float c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+  #endif
+	inline Float roundNearest(Float a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+	inline float sum(Float a)
+	{
+		__m128 s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+		s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+		s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+		return _mm_cvtss_f32(s);
+	}
+  #if defined(__F16C__) || defined(_MSC_VER)
+	inline Float loadHalf(const uint16_t* p) { return _mm256_cvtph_ps(_mm_load_si128(reinterpret_cast<const __m128i*>(p))); }
+  #else
+	inline Float loadHalf(const uint16_t* p)
+	{
+		alignas(32) float values[width];
+		for (int i = 0; i < width; i++) {
+			values[i] = halfToFloat(p[i]);
+		}
+		return load(values);
+	}
+  #endif
+	inline Float loadInt16(const int16_t* p) { return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_load_si128(reinterpret_cast<const __m128i*>(p)))); }
+#elif MFM_SIMD_SSE2
+	using Float = __m128;
+	constexpr int width = 4;
+
+	inline Float load(const float* p) { return _mm_load_ps(p); }
+	inline void store(float* p, Float a) { _mm_store_ps(p, a); }
+	inline Float broadcast(float a) { return _mm_set1_ps(a); }
+	inline Float add(Float a, Float b) { return _mm_add_ps(a, b); }
+	inline Float sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+	inline Float mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+	inline Float div(Float a, Float b) { return _mm_div_ps(a, b); }
+	inline Float mulAdd(Float a, Float b, Float c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+	// SSE2 has no round instruction; the conversion rounds to nearest under the default MXCSR mode
+	inline Float roundNearest(Float a) { return _mm_cvtepi32_ps(_mm_cvtps_epi32(a)); }
+	inline float sum(Float a)
+	{
+		__m128 s = _mm_add_ps(a, _mm_movehl_ps(a, a));
+		s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+		return _mm_cvtss_f32(s);
+	}
+	inline Float loadHalf(const uint16_t* p)
+	{
+		return _mm_setr_ps(halfToFloat(p[0]), halfToFloat(p[1]), halfToFloat(p[2]), halfToFloat(p[3]));
+	}
+	// sign-extend by unpacking into the high halves and shifting back down
+	inline Float loadInt16(const int16_t* p)
+	{
+		const __m128i values = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+		return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(values, values), 16));
+	}
+#elif MFM_SIMD_NEON
+	using Float = float32x4_t;
+	constexpr int width = 4;
+
+	inline Float load(const float* p) { return vld1q_f32(p); }
+	inline void store(float* p, Float a) { vst1q_f32(p, a); }
+	inline Float broadcast(float a) { return vdupq_n_f32(a); }
+	inline Float add(Float a, Float b) { return vaddq_f32(a, b); }
+	inline Float sub(Float a, Float b) { return vsubq_f32(a, b); }
+	inline Float mul(Float a, Float b) { return vmulq_f32(a, b); }
+	inline Float div(Float a, Float b) { return vdivq_f32(a, b); }
+	inline Float mulAdd(Float a, Float b, Float c) { return vfmaq_f32(c, a, b); }
+	inline Float roundNearest(Float a) { return vrndnq_f32(a); }
+	inline float sum(Float a) { return vaddvq_f32(a); }
+	inline Float loadHalf(const uint16_t* p) { return vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(p))); }
+	inline Float loadInt16(const int16_t* p) { return vcvtq_f32_s32(vmovl_s16(vld1_s16(p))); }
+#else
+	using Float = float;
+	constexpr int width = 1;
+
+	inline Float load(const float* p) { return *p; }
+	inline void store(float* p, Float a) { *p = a; }
+	inline Float broadcast(float a) { return a; }
+	inline Float add(Float a, Float b) { return a + b; }
+	inline Float sub(Float a, Float b) { return a - b; }
+	inline Float mul(Float a, Float b) { return a * b; }
+	inline Float div(Float a, Float b) { return a / b; }
+	inline Float mulAdd(Float a, Float b, Float c) { return a * b + c; }
+	inline Float roundNearest(Float a) { return std::nearbyint(a); }
+	inline float sum(Float a) { return a; }
+	inline Float loadHalf(const uint16_t* p) { return halfToFloat(*p); }
+	inline Float loadInt16(const int16_t* p) { return (float)*p; }
+#endif
+
+	inline Float zero() { return broadcast(0.0f); }
+
+	/** Wraps a phase in cycles to [-0.5, 0.5]. */
+	inline Float wrapPhase(Float a) { return sub(a, roundNearest(a)); }
+
+	/**
+	 * sin(x) for any x: reduces to [-pi, pi] and evaluates the same Pade
+	 * approximant as juce::dsp::FastMathApproximations::sin.
+	 */
+	inline Float sin(Float x)
+	{
+		constexpr float twoPi = 6.283185307179586f;
+		x = mulAdd(roundNearest(mul(x, broadcast(1.0f / twoPi))), broadcast(-twoPi), x);
+
+		const Float x2 = mul(x, x);
+		Float numerator = mulAdd(x2, broadcast(479249.0f), broadcast(-52785432.0f));
+		numerator = mulAdd(x2, numerator, broadcast(1640635920.0f));
+		numerator = mulAdd(x2, numerator, broadcast(-11511339840.0f));
+		numerator = mul(sub(zero(), x), numerator);
+		Float denominator = mulAdd(x2, broadcast(18361.0f), broadcast(3177720.0f));
+		denominator = mulAdd(x2, denominator, broadcast(277920720.0f));
+		denominator = mulAdd(x2, denominator, broadcast(11511339840.0f));
+		return div(numerator, denominator);
+	}
+
+	/** Rounds a count up to a whole number of vectors. */
+	inline int padToWidth(int n) { return (n + width - 1) / width * width; }
+}
+
+/*
+ * Zero-initialised float storage aligned for the widest vector we may load
+ * from it (and to cache lines).
+ */
+class AlignedBuffer
+{
+public:
+	static constexpr size_t alignment = 64;
+
+	AlignedBuffer() {}
+	~AlignedBuffer() { free(); }
+
+	AlignedBuffer(const AlignedBuffer&) = delete;
+	AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+	void allocate(size_t numFloats)
+	{
+		free();
+		if (numFloats == 0) {
+			return;
+		}
+		const size_t bytes = (numFloats * sizeof(float) + alignment - 1) / alignment * alignment;
+#if defined(_MSC_VER)
+		data = static_cast<float*>(_aligned_malloc(bytes, alignment));
+#else
+		void* p = nullptr;
+		data = posix_memalign(&p, alignment, bytes) == 0 ? static_cast<float*>(p) : nullptr;
+#endif
+		if (data == nullptr) {
+			throw std::bad_alloc();
+		}
+		std::memset(data, 0, bytes);
+		size = numFloats;
+	}
+
+	void free()
+	{
+#if defined(_MSC_VER)
+		_aligned_free(data);
+#else
+		std::free(data);
+#endif
+		data = nullptr;
+		size = 0;
+	}
+
+	/** Exchanges the two buffers' memory; does not allocate. */
+	void swap(AlignedBuffer& other) noexcept
+	{
+		std::swap(data, other.data);
+		std::swap(size, other.size);
+	}
+
+	float* get() const { return data; }
+	size_t getSize() const { return size; }
+	float& operator[](size_t i) const { return data[i]; }
+
+private:
+	float* data = nullptr;
+	size_t size = 0;
+};
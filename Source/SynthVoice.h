@@ -16,6 +16,11 @@
 #include <vector>
 #include "MFMParam.h"
 #include "MFMControl.h"
+#include "PartialBank.h"
+#include "SpectralEngine.h"
+#include "RealtimeCheck.h"
+#include "ParameterSnapshot.h"
+#include "MFMBank.h"
 #include <vector>
 
 
@@ -66,7 +71,25 @@ namespace {
 
 	class LoopSampler {
 	public:
+		LoopSampler() {}
+
 		LoopSampler(float* array, float loopStartRaw, float loopEndRaw, float sr, float overlapRaw = 0)
+		{
+			reset(array, loopStartRaw, loopEndRaw, sr, overlapRaw);
+		}
+
+		// upper bound of the cache size reset() needs for the given loop and stretch
+		static int getMaxLoopLength(float loopStartRaw, float loopEndRaw, float maxSr) {
+			return (int)std::ceil((loopEndRaw - loopStartRaw) * maxSr) + 1;
+		}
+
+		// reserve the cache up front so that reset() does not allocate
+		void reserve(int maxLoopLength) {
+			loopSamples.reserve(maxLoopLength);
+			isLoopSamplesCached.reserve(maxLoopLength);
+		}
+
+		void reset(float* array, float loopStartRaw, float loopEndRaw, float sr, float overlapRaw = 0)
 		{
 			this->array = array;
 			this->loopStart = loopStartRaw * sr;
@@ -77,8 +100,9 @@ namespace {
 			this->loopStartRaw = loopStartRaw;
 			this->loopLengthRaw = loopEndRaw - loopStartRaw;
 			loopLength = loopEnd - loopStart;
-			this->loopSamples = std::vector<float>(loopLength);
-			this->isLoopSamplesCached = std::vector<bool>(loopLength,false);
+			jassert(loopLength <= (int)loopSamples.capacity()); // reserve() was not called for this stretch
+			this->loopSamples.resize(loopLength);
+			this->isLoopSamplesCached.assign(loopLength, false);
 
 			this->recip_sr = 1.0f / sr;
 
@@ -133,32 +157,21 @@ namespace {
 		int sampleLimit;
 	};
 
-	class MultiChannelLoopSampler {
+	class TailSampler {
 	public:
-		MultiChannelLoopSampler(float* array, int channelSize, int numChannels, float sr, float loopStart, float loopEnd, float overlap = 0)
+		TailSampler() {}
+
+		TailSampler(float* array, int length, float rightMargin=0)
 		{
-			this->numChannels = numChannels;
-			for (int i = 0; i < numChannels; i++) {
-				samplers.push_back(LoopSampler(array + (channelSize*i), loopStart, loopEnd, sr, overlap));
-			}
+			reset(array, length, rightMargin);
 		}
-		float sample(int channel, int index) {
-			return samplers[channel].sample(index);
-		}
-
-	private:
-		std::vector<LoopSampler> samplers;
-		int numChannels;
-	};
 
-	class TailSampler {
-	public:
-		TailSampler(float* array, int length, float rightMargin=0) :
-			array(array),
-			length(length),
-			rightMargin(rightMargin)
+		void reset(float* array, int length, float rightMargin=0)
 		{
 			jassert(rightMargin < length);
+			this->array = array;
+			this->length = length;
+			this->rightMargin = rightMargin;
 		}
 		float sample(float index, int indexOffset) {
 			if (length == 1) {
@@ -169,9 +182,9 @@ namespace {
 		}
 
 	private:
-		float* array;
-		int length;
-		float rightMargin;
+		float* array = nullptr;
+		int length = 1;
+		float rightMargin = 0;
 	};
 }
 
@@ -188,19 +201,99 @@ public:
 	SynthVoice() {}
 
     void prepareToPlay(
-        std::map<int, std::shared_ptr<MFMParam>>* mfmParams,
         std::map<juce::String, std::shared_ptr<MFMControl>>* mfmControls,
 		std::map<int, juce::String>* channelToImage,
         int currentNoteChannel[128]
     ){
-        this->mfmParams = mfmParams;
 		this->mfmControls = mfmControls;
 		this->currentNoteChannel = currentNoteChannel;
 		this->channelToImage = channelToImage;
 
-		generateColoredNoise(noise, 80000, 2000);
+		for (int i = 0; i < ParameterSnapshot::numParameters; i++) {
+			smoothed[i].reset(getSampleRate(), getSmoothingTime(i));
+		}
+
+		stealTail.setSize(1, (int)std::ceil(stealFadeTime * getSampleRate()));
+		stealTailLength = 0;
     }
 
+	/** The buffers a voice needs for notes of up to a number of partials, see growNoteState(). */
+	struct NoteState
+	{
+		explicit NoteState(int maxNumPartials)
+		{
+			partials.allocate(maxNumPartials);
+			amplitude.allocate(maxNumPartials);
+			phase.allocate(maxNumPartials);
+			noiseSampleShifts.assign(maxNumPartials * 2, 0);
+		}
+
+		PartialBank partials;
+		// the spectral engine's per-frame inputs
+		AlignedBuffer amplitude, phase;
+		std::vector<unsigned int> noiseSampleShifts;
+	};
+
+	/**
+	 * Sizes everything startNote needs for notes of up to maxNumPartials
+	 * partials, so that starting a note only resets indices and pointers.
+	 * Allocates; for a voice the audio thread cannot see yet, otherwise see
+	 * growNoteState().
+	 */
+	void allocateNoteState(int maxNumPartials)
+	{
+		if (maxNumPartials > partials.getCapacity()) {
+			NoteState state(maxNumPartials);
+			growNoteState(state);
+		}
+	}
+
+	/**
+	 * Takes over the buffers of `state`, built off the audio thread for more
+	 * partials than the voice has; `state` is left with the old buffers. A
+	 * note that is playing keeps playing. Does not allocate, so it can be
+	 * called before publishing a bank with larger notes, with the audio
+	 * callback locked out.
+	 */
+	void growNoteState(NoteState& state)
+	{
+		if (state.partials.getCapacity() <= partials.getCapacity()) {
+			return;
+		}
+		partials.grow(state.partials);
+		// filled again for every frame
+		spectralEngine.amplitude.swap(state.amplitude);
+		spectralEngine.phase.swap(state.phase);
+		std::copy(noiseSampleShifts.begin(), noiseSampleShifts.end(), state.noiseSampleShifts.begin());
+		noiseSampleShifts.swap(state.noiseSampleShifts);
+	}
+
+	/**
+	 * The bank new notes are taken from, on the audio thread at the start of a
+	 * block. A sounding note keeps playing from the bank it started with; the
+	 * processor keeps that bank alive, see getNoteBank().
+	 */
+	void setBank(const MFMBank* bank)
+	{
+		this->bank = bank;
+	}
+
+	/** The bank the sounding note plays from, nullptr if the voice is idle. */
+	const MFMBank* getNoteBank() const
+	{
+		return state == VoiceState::IDLE ? nullptr : noteBank;
+	}
+
+	/**
+	 * The note whose table the sounding note plays, which is not the note
+	 * played while that one is still loading (see MFMBank::findOrNearest());
+	 * -1 if the voice is idle.
+	 */
+	int getParamNote() const
+	{
+		return state == VoiceState::IDLE ? -1 : paramNote;
+	}
+
     bool canPlaySound (juce::SynthesiserSound* sound) override
     {
         return dynamic_cast <SynthSound*>(sound) != nullptr;
@@ -208,47 +301,78 @@ public:
 
 
 
-	void setValueTree(AudioProcessorValueTreeState& valueTree)
+	void setParameters(ParameterSnapshot& parameters)
+	{
+		this->parameters = &parameters;
+	}
+
+	/**
+	 * Level of detail requested by the processor's RenderGovernor: render at
+	 * most numPartials / 2^partialSteps partials (but not fewer than
+	 * minRenderedPartials), and use the recurrence kernel instead of the
+	 * direct one if cheapOscillator is set.
+	 */
+	void setRenderDetail(int partialSteps, bool cheapOscillator)
+	{
+		this->partialSteps = partialSteps;
+		this->cheapOscillator = cheapOscillator;
+	}
+
+	/** The peak output of the last block, for ranking voices by loudness. */
+	float getOutputLevel() const
 	{
-		this->valueTree = &valueTree;
+		return state == VoiceState::IDLE ? 0 : outputLevel;
+	}
+
+	/** The voice's own buffers, sized by allocateNoteState(); the tables it reads belong to the bank. */
+	size_t getMemoryBytes() const
+	{
+		return partials.getBytes() + spectralEngine.getBytes() + noiseSampleShifts.capacity() * sizeof(unsigned int)
+			+ (size_t)stealTail.getNumChannels() * stealTail.getNumSamples() * sizeof(float);
+	}
+
+	static constexpr int minRenderedPartials = 8;
+
+	/** Whether the next renderNextBlock() produces any output. */
+	bool isRendering() const
+	{
+		return isVoiceActive() || stealTailPosition < stealTailLength;
 	}
 
     
     void startNote (int midiNoteNumber, float velocity, SynthesiserSound* sound, int currentPitchWheelPosition) override
     {
+		// everything was allocated in allocateNoteState()
+		ScopedNoAllocation noAllocation;
 
-
-		// if mfmParams do not have midiNoteNumber, play nothing
-        if (mfmParams->find(midiNoteNumber) == mfmParams->end()) {
-			param.reset();
+		// if the bank does not have midiNoteNumber, play nothing; if its table
+		// is still loading, play the nearest loaded note at this pitch
+		param = bank != nullptr ? bank->findOrNearest(midiNoteNumber, &paramNote) : nullptr;
+        if (param == nullptr) {
 			clearCurrentNote();
             state = VoiceState::IDLE;
 			return;
         }
-
-        // select param
-		param = (*mfmParams)[midiNoteNumber];
+		noteBank = bank;
 
 		frameIdx = 0;
 
-		// initialize loop samplers
-		//const float loopStart = getParam("loopStart") * param->param_sr;
-		//const float loopEnd = std::fmin(getParam("loopEnd") * param->param_sr, param->num_samples
-
-		// for now loop start and end are hardcoded
-		const float loopStart = 0.4 * param->param_sr;
-		const float loopEnd = std::fmin(1.25 * param->param_sr, param->num_samples);
-		const float loopOverlap = 0.5 * param->param_sr;
-
-		const float audioParamSampleRatio =  ((float)getSampleRate())/ ((float) param->param_sr);
-		magGlobal = std::make_unique<MultiChannelLoopSampler>(param->magGlobal.get(), param->num_samples, param->num_partials, audioParamSampleRatio, loopStart, loopEnd, loopOverlap);
-		alphaGlobal = std::make_unique<MultiChannelLoopSampler>(param->alphaGlobal.get(), param->num_samples, param->num_partials, audioParamSampleRatio, loopStart, loopEnd, loopOverlap);
-		noiseSampler1 = std::make_unique<LoopSampler>(noise, 5000, 60000, (2000/ param->coloredCutoff1), 10);
-		noiseSampler2 = std::make_unique<LoopSampler>(noise, 5000, 60000, (2000 / param->coloredCutoff2), 10);
-
-		
-		alphaLocalEnv1 = std::make_unique<MultiChannelLoopSampler>(param->alphaLocalEnv1.get(), param->num_samples, param->num_partials, audioParamSampleRatio, loopStart, loopEnd, loopOverlap);
-		alphaLocalEnv2 = std::make_unique<MultiChannelLoopSampler>(param->alphaLocalEnv2.get(), param->num_samples, param->num_partials, audioParamSampleRatio, loopStart, loopEnd, loopOverlap);
+		// the looped tables are shared by all voices, we only keep a cursor into them
+		jassert(!param->frameTable.isEmpty() || param->magGlobalLoop.hasData());
+		tablePos = 0;
+		tableStep = param->param_sr / getSampleRate();
+		tableFrame = -1;
+
+		noiseTable1 = bank->getNoise().find(param->coloredCutoff1);
+		noiseTable2 = bank->getNoise().find(param->coloredCutoff2);
+		if (noiseTable1 == nullptr || noiseTable2 == nullptr) {
+			// the bank's noise is generated once the sample rate is known
+			param = nullptr;
+			noiseTable1 = noiseTable2 = nullptr;
+			clearCurrentNote();
+			state = VoiceState::IDLE;
+			return;
+		}
 
 		// select control
 		/*juce::String controlToUse = (*channelToImage)[currentNoteChannel[midiNoteNumber]];
@@ -259,41 +383,63 @@ public:
 
 		//auto currentChannel = currentNoteChannel[midiNoteNumber];
 		auto currentChannel = 1; // images are disabled for now
-		if (channelToImage->find(currentChannel) == channelToImage->end()) {
+		auto imageIt = channelToImage->find(currentChannel);
+		if (imageIt == channelToImage->end()) {
 			state = VoiceState::IDLE;
 			return;
 		}
-		auto controlName = (*channelToImage)[currentChannel];
-		if (mfmControls->find(controlName) == mfmControls->end()) {
+		auto controlIt = mfmControls->find(imageIt->second);
+		if (controlIt == mfmControls->end()) {
 			state = VoiceState::IDLE;
 			return;
 		}
-		auto control = (*mfmControls)[controlName];
+		control = controlIt->second;
 
 		int rightMargin = std::min(control->length-1, 5);
-		intensityS = std::make_unique<TailSampler>(control->intensity.get(), control->length, rightMargin);
-		pitchS = std::make_unique<TailSampler>(control->pitch.get(), control->length, rightMargin);
-		densityS = std::make_unique<TailSampler>(control->density.get(), control->length, rightMargin);
-		hueS = std::make_unique<TailSampler>(control->hue.get(), control->length, rightMargin);
-		saturationS = std::make_unique<TailSampler>(control->saturation.get(), control->length, rightMargin);
-		valueS = std::make_unique<TailSampler>(control->value.get(), control->length, rightMargin);
+		intensityS.reset(control->intensity.get(), control->length, rightMargin);
+		pitchS.reset(control->pitch.get(), control->length, rightMargin);
+		densityS.reset(control->density.get(), control->length, rightMargin);
+		hueS.reset(control->hue.get(), control->length, rightMargin);
+		saturationS.reset(control->saturation.get(), control->length, rightMargin);
+		valueS.reset(control->value.get(), control->length, rightMargin);
 
 
 		state = VoiceState::SUSTAIN;
         timeAfterNoteStop = 0;
         time = 0;
-		for (int i = 0; i < param->num_partials; i++) {
-            ft[i] = 0;
+
+		// a new note starts at the current parameter values
+		for (int i = 0; i < ParameterSnapshot::numParameters; i++) {
+			smoothed[i].setCurrentAndTargetValue((*parameters)[i]);
+		}
+		magControlValid = false;
+
+		// reset carrier phases and load the per-note alphaLocal modulators
+		const float dt = 1.0 / getSampleRate();
+		partials.reset(param->num_partials);
+		spectralEngine.reset();
+		for (int i = 0; i < partials.getNumPartials(); i++) {
+			partials.modPhase1[i] = -0.5f;
+			partials.modPhase2[i] = -0.5f;
+			partials.modInc1[i] = param->alphaLocalSpreadingCenter[i * 2] * dt;
+			partials.modInc2[i] = param->alphaLocalSpreadingCenter[i * 2 + 1] * dt;
+			partials.modDepth1[i] = param->alphaLocalSpreadingFactor[i * 2];
+			partials.modDepth2[i] = param->alphaLocalSpreadingFactor[i * 2 + 1];
+			partials.modGain1[i] = param->alphaLocalNoiseGain[i * 2] * param->alphaLocalGain[i];
+			partials.modGain2[i] = param->alphaLocalNoiseGain[i * 2 + 1] * param->alphaLocalGain[i];
+			partials.alphaLocalBound[i] = std::abs(partials.modGain1[i]) * param->alphaLocalEnv1Loop.getMaxAbs(i)
+				+ std::abs(partials.modGain2[i]) * param->alphaLocalEnv2Loop.getMaxAbs(i);
+			partials.alphaGlobalRate[i] = param->alphaGlobalLoop.getMaxAbsSlope(i);
 		}
 		this->pitch = midiNoteNumber;
         this->velocity = velocity;
         baseFrequency = MidiMessage::getMidiNoteInHertz(midiNoteNumber);
         //frequency = param->base_freq;
 
-		// fill random values from 0-40000 in noisesampleShifts
+		// every partial reads the noise tables from its own random offset
 		Random r;
-		for (int i = 0; i < noiseSampleShifts.size(); i++) {
-			noiseSampleShifts[i] = r.nextInt(40000);
+		for (int i = 0; i < partials.getNumPartials() * 2; i++) {
+			noiseSampleShifts[i] = (unsigned int)r.nextInt(1 << 30);
 		}
     }
     
@@ -303,13 +449,17 @@ public:
 			state = VoiceState::RELEASE;
         }
         else {
+			// the voice is being stolen or silenced: play out a short fade of the
+			// note so that it does not stop with a click
+			renderStealTail();
+			state = VoiceState::IDLE;
             clearCurrentNote();
         }
     }
     
     void pitchWheelMoved (int value) override
     {
-		setParam(*valueTree, "pitchVariance", value / 16384.0f);
+		parameters->setNormalised(ParameterSnapshot::pitchVariance, value / 16384.0f);
     }
     
     void controllerMoved (int controllerNumber, int newControllerValue) override
@@ -319,12 +469,21 @@ public:
     
     void renderNextBlock (AudioBuffer <float> &outputBuffer, int startSample, int numSamples) override
 	{
+		mixStealTail(outputBuffer, startSample, numSamples);
+
 		if(param == nullptr) {
 	        return;
         }
 		if (state == VoiceState::IDLE) {
 			return;
 		}
+		if (noiseTable1 == nullptr || noiseTable2 == nullptr) {
+			// only startNote() sets them, from the bank the note plays from
+			jassertfalse;
+			clearCurrentNote();
+			state = VoiceState::IDLE;
+			return;
+		}
 		if (state == VoiceState::RELEASE && timeAfterNoteStop > 0.3) {
 			clearCurrentNote();
 			state = VoiceState::IDLE;
@@ -349,21 +508,22 @@ public:
 		//float resonance = saturationS->sample(cIdx, 0);
 		//float sharpness = valueS->sample(cIdx, 0);
 
-		float intensity = getParam("intensity", 0.02);
-		float roughness = getParam("roughness", 0.02);
-		float pitchVar = getParam("pitchVariance", 0.02);
-		float bowPos = getParam("bowPosition", 0.02);
-		float resonance = getParam("resonance", 0.02);
-		float sharpness = getParam("sharpness", 0.02);
-		float vibrato = getParam("vibrato", 0.02);
+		// ramp every parameter towards this block's snapshot
+		for (int i = 0; i < ParameterSnapshot::numParameters; i++) {
+			smoothed[i].setTargetValue((*parameters)[i]);
+		}
+
+		// controls that are applied per block take their value at the block start
+		float intensity = getBlockValue(ParameterSnapshot::intensity, numSamples);
+		float roughness = getBlockValue(ParameterSnapshot::roughness, numSamples);
+		float pitchVar = getBlockValue(ParameterSnapshot::pitchVariance, numSamples);
+		float bowPos = getBlockValue(ParameterSnapshot::bowPosition, numSamples);
+		float resonance = getBlockValue(ParameterSnapshot::resonance, numSamples);
+		float sharpness = getBlockValue(ParameterSnapshot::sharpness, numSamples);
+		float vibrato = getBlockValue(ParameterSnapshot::vibrato, numSamples);
 		// precompute some constants outside the sample loop
-        float recip_two_pi = 1.0f / (2 * float_Pi);
         const float dt = 1.0 / getSampleRate();
-        const float attackFactor = 1.0f / param->envelope[(int)(((float)param->attackLen) / param->sampleRate * param->param_sr) - 1];
-
-        const float gain = getParam("gain");
-        
-        float pIdx = time * param->param_sr;
+        const float attackFactor = 1.0f / param->envelope[(size_t)param->getAttackEnvelopeIndex()];
 		
 
 		float vibratoTime = time;
@@ -381,98 +541,100 @@ public:
 
 		const float frequency = baseFrequency * exp2f((pitchVar + vibratoValue*0.1) / 12); // pitch in semitones
 
-		float magControl[100] = { 1 };
-		float alphaControl[100] = { 1 };
+		const int numPartials = partials.getNumPartials();
 
-		for (int i = 0; i < param->num_partials; i++) {
-			int n = i + 1;
-			float overtoneFreq = frequency * n;
-			// apply intensity
-			magControl[i] = intensity;
-			// apply bowPos
-			magControl[i] *= (1 - (1 - std::fmax( 0,std::fmin(1,std::abs(n - (1.0f / bowPos))))) * (timbreGain - 1));
+		// alphaControl is the same for every partial
+		float alphaControl = roughness * 0.15;
+		if (time < 0.5) {
+			alphaControl *= time / 0.5;
+		}
+		if (state == VoiceState::RELEASE) {
+			alphaControl *= fmax(0, 1 - timeAfterNoteStop / 0.01);
+		}
+		//TODO: apply density to noise
+
+		// magControl only depends on the controls and on which partials are below
+		// 1000 Hz (saturation) and above 5000 Hz (value), so it is only rebuilt
+		// when one of those changes
+		const MagControlInputs magInputs = {
+			intensity, bowPos, resonance, sharpness,
+			std::min(numPartials, (int)std::floor(1000 / frequency)),
+			(int)std::ceil(5000 / frequency)
+		};
+		if (!magControlValid || !(magInputs == magControlInputs)) {
+			const float resonanceGain = pow(10, (-3 + resonance * 6)*6 / 20);
+			const float sharpnessGain = pow(10, (-3 + sharpness * 6)*6 / 20);
+
+			for (int i = 0; i < numPartials; i++) {
+				int n = i + 1;
+				float magControl;
+				// apply intensity
+				magControl = intensity;
+				// apply bowPos
+				magControl *= (1 - (1 - std::fmax( 0,std::fmin(1,std::abs(n - (1.0f / bowPos))))) * (timbreGain - 1));
+
+				// apply saturation
+				if (n <= magInputs.lowBandEnd) {
+					magControl *= resonanceGain;
+				}
 
-			// apply saturation
-			if (overtoneFreq <= 1000) {
-				magControl[i] *= pow(10, (-3 + resonance * 6)*6 / 20);
-			}
+				// apply value
+				if (n >= magInputs.highBandStart) {
+					magControl *= sharpnessGain;
+				}
 
-			// apply value
-			if (overtoneFreq >= 5000) {
-				magControl[i] *= pow(10, (-3 + sharpness * 6)*6 / 20);
+				partials.magControl[i] = magControl;
 			}
+			magControlInputs = magInputs;
+			magControlValid = true;
+		}
 
-			alphaControl[i] = roughness * 0.15; 
-			if (time < 0.5) {
-				alphaControl[i] *= time / 0.5;
-			}
-			if (state == VoiceState::RELEASE) {
-				alphaControl[i] *= fmax(0,1 - timeAfterNoteStop / 0.01);
-			}
-			//TODO: apply density to noise
+		const float fundamentalInc = frequency * dt;
+		for (int i = 0; i < numPartials; i++) {
+			partials.carrierInc[i] = fundamentalInc * (i + 1);
+		}
+
+		int oscillatorMode = (int)(*parameters)[ParameterSnapshot::oscillator];
+		if (cheapOscillator && oscillatorMode == OscillatorMode::direct) {
+			oscillatorMode = OscillatorMode::recurrence;
+		}
+		const bool useSpectral = oscillatorMode == OscillatorMode::spectral;
+		if (useSpectral && !spectralActive) {
+			spectralEngine.reset();
 		}
+		spectralActive = useSpectral;
 
+		// cull the partials above Nyquist or below audibility from the frame at the
+		// block start, which the recurrence kernel also anchors its carriers at
+		const float blockFrac = loadTableFrame();
+		const int maxAudible = std::max(numPartials >> partialSteps, std::min(numPartials, minRenderedPartials));
+		partials.beginBlock(numSamples, (float)(1 / (partialFadeTime * getSampleRate())), maxAudible);
+		const bool useRecurrence = oscillatorMode == OscillatorMode::recurrence
+			&& partials.beginRecurrenceBlock(blockFrac, alphaControl, tableStep * numSamples + 1);
 
+		float blockPeak = 0;
         for (int sample = 0; sample < numSamples; ++sample)
         {
             time += dt;
-			float y = 0;
-
-            for (int i = 0; i < param->num_partials; i++) {
-				int n = i + 1;
-				const float mag = magGlobal->sample(i, frameIdx) * magControl[i];
-				ft[i] += frequency * n * dt;
+			const float gain = smoothed[ParameterSnapshot::gain].getNextValue();
+			const float attack = smoothed[ParameterSnapshot::attack].getNextValue();
 
-				// limit 2 pi f t in -pi to pi
-				if (ft[i] > 0.5) {
-					ft[i] -= 1;
+			float y;
+			if (useSpectral) {
+				if (spectralEngine.needsFrame()) {
+					renderSpectralFrame(sample, alphaControl);
 				}
-				
-				float alphaLocal;
-				{
-					// calculate alphaLocal
-					float c1 = param->alphaLocalSpreadingCenter[i * 2];
-					float c2 = param->alphaLocalSpreadingCenter[i * 2 + 1];
-					float fac1 = param->alphaLocalSpreadingFactor[i * 2];
-					float fac2 = param->alphaLocalSpreadingFactor[i * 2 + 1];
-					float noiseGain1 = param->alphaLocalNoiseGain[i * 2];
-					float noiseGain2 = param->alphaLocalNoiseGain[i * 2 + 1];
-					float env1 = alphaLocalEnv1->sample(i, frameIdx);
-					float env2 = alphaLocalEnv2->sample(i, frameIdx);
-					float alphaLocalGain = param->alphaLocalGain[i];
-
-
-					float phase1 = noiseSampler1->sample(frameIdx + noiseSampleShifts[i*2]);
-					float phase2 = noiseSampler2->sample(frameIdx + noiseSampleShifts[i*2+1]);
-
-					//alpha_local = np.sin(2 * np.pi * c1 * t_sus + fac1 * phase1) * env1 * ng1 \
-					//	+ np.sin(2 * np.pi * c2 * t_sus + fac2 * phase2) * env2 * ng2
-
-					float ft1, ft2;
-
-					ft1 = c1 * time;
-					ft1 = fmod(ft1, 1) - 0.5;
-
-					ft2 = c2 * time;
-					ft2 = fmod(ft2, 1) - 0.5;
-
-					alphaLocal = juce::dsp::FastMathApproximations::sin(
-						twoPi * ft1 + fac1 * phase1
-					) * env1 * noiseGain1
-					+ juce::dsp::FastMathApproximations::sin(
-						twoPi * ft2 + fac2 * phase2
-					) * env2 * noiseGain2;
-
-					alphaLocal *= alphaLocalGain * alphaControl[i];
-				}
-
+				y = spectralEngine.getNextSample();
+			}
+			else {
+				const float frac = loadTableFrame();
 
+				// gather this sample's noise values, then render all partials at once
+				gatherNoise(frameIdx);
 
-				float alpha = alphaLocal + alphaGlobal->sample(i, frameIdx);
-                float stuff_in_sin = twoPi * ft[i] + alpha;
-				stuff_in_sin = stuff_in_sin - twoPi * juce::roundToInt(stuff_in_sin * recip_two_pi);
-				y += mag * juce::dsp::FastMathApproximations::sin(stuff_in_sin);
-            }
+				y = useRecurrence ? partials.renderSampleRecurrence(frac, alphaControl)
+					: partials.renderSample(frac, alphaControl);
+			}
 			
 			if (state == VoiceState::RELEASE) {
                 timeAfterNoteStop += dt;
@@ -490,10 +652,10 @@ public:
 					// cosine crossfade
 					//float lerp1 = sinf(lerp * float_Pi * 0.5);
 					//float lerp2 = sinf((1 - lerp) * float_Pi * 0.5);
-					y = param->attackWave[attackU]*getParam("attack") * attackFactor * intensity * lerp2 + y * lerp1;
+					y = param->attackWave[attackU] * attack * attackFactor * intensity * lerp2 + y * lerp1;
                 }
                 else {
-                    y = param->attackWave[attackU] * getParam("attack") * attackFactor * intensity;
+                    y = param->attackWave[attackU] * attack * attackFactor * intensity;
                 }
             }
 
@@ -508,6 +670,7 @@ public:
 			y *= 1 + 0.5 * vibratoValue;
 
 			y *= velocity;
+			blockPeak = std::max(blockPeak, std::abs(y));
 
             for (int channel = 0; channel < outputBuffer.getNumChannels(); ++channel)
             {
@@ -515,16 +678,60 @@ public:
             }
             ++startSample;
 			++frameIdx;
+			tablePos = param->magGlobalLoop.wrap(tablePos + tableStep);
         }
+
+		if (useRecurrence || useSpectral) {
+			partials.advanceCarriers(numSamples);
+		}
+		if (useSpectral) {
+			partials.advanceModulators(numSamples);
+		}
+		partials.endBlock(numSamples);
+		outputLevel = blockPeak;
     }
 
+	enum OscillatorMode {
+		direct,
+		recurrence,
+		spectral
+	};
+
 
 private:
 
-	AudioProcessorValueTreeState* valueTree;
+	ParameterSnapshot* parameters = nullptr;
+	std::array<SmoothedValue<float>, ParameterSnapshot::numParameters> smoothed;
+
+	// the inputs partials.magControl was last computed from
+	struct MagControlInputs {
+		float intensity, bowPos, resonance, sharpness;
+		int lowBandEnd, highBandStart;
+
+		bool operator==(const MagControlInputs& other) const {
+			return intensity == other.intensity && bowPos == other.bowPos
+				&& resonance == other.resonance && sharpness == other.sharpness
+				&& lowBandEnd == other.lowBandEnd && highBandStart == other.highBandStart;
+		}
+	};
+	MagControlInputs magControlInputs = {};
+	bool magControlValid = false;
 
     float time = 0;
-	std::vector<float> ft = std::vector<float>(100);
+    PartialBank partials;
+	SpectralEngine spectralEngine;
+	bool spectralActive = false;
+
+	// the fade-out of a stolen note, see renderStealTail()
+	static constexpr double stealFadeTime = 0.005;
+	AudioBuffer<float> stealTail;
+	int stealTailLength = 0;
+	int stealTailPosition = 0;
+
+	// level of detail, see setRenderDetail()
+	int partialSteps = 0;
+	bool cheapOscillator = false;
+	float outputLevel = 0;
     int pitch;
     double velocity;
     double baseFrequency;
@@ -532,77 +739,126 @@ private:
     float timeAfterNoteStop;
 	enum VoiceState state = VoiceState::IDLE;
 
-	std::map<int, std::shared_ptr<MFMParam>>* mfmParams = nullptr;
-    std::shared_ptr<MFMParam> param;
-	std::unique_ptr<MultiChannelLoopSampler> magGlobal;
-	std::unique_ptr<MultiChannelLoopSampler> alphaGlobal, alphaLocalEnv1, alphaLocalEnv2;
-	std::unique_ptr<LoopSampler> noiseSampler1, noiseSampler2;
+	const MFMBank* bank = nullptr;
+	const MFMBank* noteBank = nullptr;
+    const MFMParam* param = nullptr;
+	int paramNote = -1;
+	const NoiseBank::Table* noiseTable1 = nullptr;
+	const NoiseBank::Table* noiseTable2 = nullptr;
 
 	std::map<juce::String, std::shared_ptr<MFMControl>>* mfmControls = nullptr;
 	std::shared_ptr<MFMControl> control;
 
 	std::map<int, juce::String>* channelToImage = nullptr;
 
-	std::unique_ptr<TailSampler> intensityS, pitchS, densityS, hueS, saturationS, valueS;
+	TailSampler intensityS, pitchS, densityS, hueS, saturationS, valueS;
 
 	int* currentNoteChannel;
 	int frameIdx = 0;
 
-	float noise[80000];
+	// position in the looped parameter tables, in frames at param_sr
+	double tablePos = 0;
+	double tableStep = 0;
+	int tableFrame = -1;
+
+	std::vector<unsigned int> noiseSampleShifts;
+
+	// how long a culled partial takes to fade out or back in
+	static constexpr double partialFadeTime = 0.005;
+
+	// seconds to ramp to a new value
+	static double getSmoothingTime(int id) {
+		switch (id) {
+		case ParameterSnapshot::gain:
+		case ParameterSnapshot::attack:
+			return 0.02;
+		case ParameterSnapshot::inputChannel:
+		case ParameterSnapshot::oscillator:
+		case ParameterSnapshot::parallelRender:
+			return 0;
+		default:
+			return 0.05;
+		}
+	}
+
+	// renders the next stealFadeTime of the playing note, faded out, to be
+	// mixed into the following blocks by mixStealTail()
+	void renderStealTail() {
+		stealTailLength = 0;
+		stealTailPosition = 0;
+		if (param == nullptr || state == VoiceState::IDLE || stealTail.getNumSamples() == 0) {
+			return;
+		}
 
-	std::vector<float> noiseSampleShifts = std::vector<float>(100);
+		const int length = stealTail.getNumSamples();
+		stealTail.clear();
+		renderNextBlock(stealTail, 0, length);
 
-	void generateColoredNoise(float* buffer, int length, float cutoff) {
-		Random r;
+		float* tail = stealTail.getWritePointer(0);
 		for (int i = 0; i < length; i++) {
-			buffer[i] = r.nextFloat() * 2 - 1;
+			tail[i] *= 1 - (i + 1) / (float)length;
 		}
-
-		juce::dsp::IIR::Filter<float> filter;
-		filter.coefficients = juce::dsp::IIR::Coefficients<float>::makeLowPass(getSampleRate(), cutoff);
-		juce::dsp::AudioBlock<float> block(&buffer, 1, length);
-		juce::dsp::ProcessContextReplacing<float> context(block);
-		filter.process(context);
-		filter.process(context);
-		filter.process(context);
-		filter.process(context);
+		stealTailLength = length;
 	}
 
-	void setParam(AudioProcessorValueTreeState& valueTree, String paramId, float value)
-	{
-		//valueTree.getParameter(paramId)->beginChangeGesture();
-		valueTree.getParameter(paramId)->setValueNotifyingHost(value);
-		//valueTree.getParameter(paramId)->endChangeGesture();
+	void mixStealTail(AudioBuffer<float>& outputBuffer, int startSample, int numSamples) {
+		const int count = std::min(numSamples, stealTailLength - stealTailPosition);
+		if (count <= 0) {
+			return;
+		}
+		for (int channel = 0; channel < outputBuffer.getNumChannels(); ++channel) {
+			outputBuffer.addFrom(channel, startSample, stealTail, 0, stealTailPosition, count);
+		}
+		stealTailPosition += count;
 	}
 
-	float getParam(String paramId, float smooth_half_life = 0.0f) {
-		if (lastParamValues.find(paramId) == lastParamValues.end()) {
-			lastGetParamValueTime[paramId] = time;
-			lastParamValues[paramId] = valueTree->getRawParameterValue(paramId)->load();
+	// the tables only need reloading when we enter a new parameter frame;
+	// returns how far the cursor is into the frame
+	float loadTableFrame() {
+		const int frame = (int)tablePos;
+		if (frame != tableFrame) {
+			if (!param->frameTable.isEmpty()) {
+				partials.loadFrame(param->frameTable, frame);
+			}
+			else {
+				partials.loadFrame(param->magGlobalLoop, param->alphaGlobalLoop, param->alphaLocalEnv1Loop, param->alphaLocalEnv2Loop, frame);
+			}
+			tableFrame = frame;
 		}
-		float value = valueTree->getRawParameterValue(paramId)->load();
-		float lastValue = lastParamValues[paramId];
-		float time = this->time;
-		float lastTime = lastGetParamValueTime[paramId];
-		float dt = time - lastTime;
-		float smooth;
-		if (dt < 0 || dt > 0.5) {
-			smooth = 0;
+		return (float)(tablePos - frame);
+	}
+
+	void gatherNoise(int index) {
+		jassert(noiseTable1 != nullptr && noiseTable2 != nullptr);
+		const auto& table1 = *noiseTable1;
+		const auto& table2 = *noiseTable2;
+		for (int i = 0; i < partials.getNumPartials(); i++) {
+			partials.noise1[i] = table1[(unsigned int)index + noiseSampleShifts[i * 2]];
+			partials.noise2[i] = table2[(unsigned int)index + noiseSampleShifts[i * 2 + 1]];
 		}
-		else if (smooth_half_life < 0.01f) {
-			smooth = 0;
+	}
+
+	// synthesises the spectral frame whose triangle starts at `sample` of the
+	// block, from the partials at the triangle's centre one hop later
+	void renderSpectralFrame(int sample, float alphaControl) {
+		const int ahead = SpectralEngine::hopSize;
+		gatherNoise(frameIdx + ahead);
+		const double position = param->magGlobalLoop.wrap(tablePos + tableStep * ahead);
+		if (!param->frameTable.isEmpty()) {
+			partials.evaluate(param->frameTable, position, sample + ahead + 1, alphaControl,
+				spectralEngine.amplitude.get(), spectralEngine.phase.get());
 		}
 		else {
-			smooth = pow(0.5, dt / smooth_half_life); // half life in seconds
+			partials.evaluate(param->magGlobalLoop, param->alphaGlobalLoop, param->alphaLocalEnv1Loop, param->alphaLocalEnv2Loop,
+				position, sample + ahead + 1, alphaControl, spectralEngine.amplitude.get(), spectralEngine.phase.get());
 		}
-
-		lastParamValues[paramId] = value * (1 - smooth) + lastValue * smooth;
-		lastGetParamValueTime[paramId] = time;
-		return lastParamValues[paramId];
+		spectralEngine.synthesiseFrame(partials.carrierInc, partials.getNumPartials());
 	}
 
-
-
-	std::map<String, float> lastParamValues;
-	std::map<String, float> lastGetParamValueTime;
+	// value at the start of the block, then advance the ramp past it
+	float getBlockValue(ParameterSnapshot::Id id, int numSamples) {
+		const float value = smoothed[id].getCurrentValue();
+		smoothed[id].skip(numSamples);
+		return value;
+	}
 };
@@ -10,22 +10,130 @@
 #include<iomanip>
 #include<stdint.h>
 #include<stdexcept>
-#include <regex>
+#include <atomic>
 #include <JuceHeader.h>
 
-cnpy::NpyArray cnpy::read_npz(std::string path, std::string key) {
-    auto file = juce::File(path);
-    juce::ZipFile archive = juce::ZipFile(file);
-    auto* entry = archive.getEntry(key + ".npy");
-    auto stream = archive.createStreamForEntry(*entry);
+namespace {
+    std::atomic<int> log_level { (int)cnpy::LogLevel::archives };
+
+    bool should_log(cnpy::LogLevel level) {
+        return log_level.load(std::memory_order_relaxed) >= (int)level;
+    }
+
+    // the shape tuple, e.g. "(88, 2, 1200)", "(3,)" or "()"
+    void parse_shape(const std::string& str_shape, std::vector<size_t>& shape) {
+        shape.clear();
+        size_t value = 0;
+        bool in_number = false;
+        for (char c : str_shape) {
+            if (c >= '0' && c <= '9') {
+                value = value * 10 + (size_t)(c - '0');
+                in_number = true;
+            }
+            else if (in_number) {
+                shape.push_back(value);
+                value = 0;
+                in_number = false;
+            }
+        }
+        if (in_number)
+            shape.push_back(value);
+    }
+
+    void parse_header_dict(const std::string& header, size_t& word_size, std::vector<size_t>& shape, bool& fortran_order) {
+        size_t loc1, loc2;
+
+        //fortran order
+        loc1 = header.find("fortran_order");
+        if (loc1 == std::string::npos)
+            throw std::runtime_error("parse_npy_header: failed to find header keyword: 'fortran_order'");
+        loc1 += 16;
+        fortran_order = (header.compare(loc1, 4, "True") == 0);
+
+        //shape
+        loc1 = header.find("(");
+        loc2 = header.find(")");
+        if (loc1 == std::string::npos || loc2 == std::string::npos)
+            throw std::runtime_error("parse_npy_header: failed to find header keyword: '(' or ')'");
+        parse_shape(header.substr(loc1 + 1, loc2 - loc1 - 1), shape);
+
+        //endian, word size, data type
+        //byte order code | stands for not applicable. 
+        //not sure when this applies except for byte array
+        loc1 = header.find("descr");
+        if (loc1 == std::string::npos)
+            throw std::runtime_error("parse_npy_header: failed to find header keyword: 'descr'");
+        loc1 += 9;
+        if (loc1 + 2 >= header.size())
+            throw std::runtime_error("parse_npy_header: truncated header");
+        bool littleEndian = (header[loc1] == '<' || header[loc1] == '|' ? true : false);
+        assert(littleEndian);
+
+        //char type = header[loc1+1];
+        //assert(type == map_type(T));
+
+        word_size = (size_t)atoi(header.c_str() + loc1 + 2);
+    }
+}
+
+void cnpy::set_log_level(LogLevel level) {
+    log_level.store((int)level, std::memory_order_relaxed);
+}
+
+cnpy::LogLevel cnpy::get_log_level() {
+    return (LogLevel)log_level.load(std::memory_order_relaxed);
+}
+
+cnpy::NpzArchive::NpzArchive(const std::string& path) : path(path) {
+    auto stream = std::make_unique<juce::FileInputStream>(juce::File(path));
+    if (!stream->openedOk())
+        throw std::runtime_error("NpzArchive: unable to open " + path);
+
+    // one pass over the central directory; all entries share the stream
+    zip = std::make_unique<juce::ZipFile>(stream.release(), true);
+    for (int i = 0; i < zip->getNumEntries(); i++) {
+        juce::String name = zip->getEntry(i)->filename;
+        if (name.endsWith(".npy"))
+            name = name.dropLastCharacters(4);
+        index[name.toStdString()] = i;
+    }
+
+    if (should_log(LogLevel::archives))
+        juce::Logger::writeToLog("reading npz file: " + juce::String(path) + " (" + juce::String((int)index.size()) + " arrays)");
+}
+
+bool cnpy::NpzArchive::contains(const std::string& key) const {
+    return index.find(key) != index.end();
+}
+
+std::vector<std::string> cnpy::NpzArchive::keys() const {
+    std::vector<std::string> result;
+    for (const auto& entry : index)
+        result.push_back(entry.first);
+    return result;
+}
+
+cnpy::NpyArray cnpy::NpzArchive::load(const std::string& key) {
+    auto it = index.find(key);
+    if (it == index.end())
+        throw std::runtime_error("NpzArchive: " + path + " has no array " + key);
+
+    std::unique_ptr<juce::InputStream> stream(zip->createStreamForEntry(it->second));
+    if (stream == nullptr)
+        throw std::runtime_error("NpzArchive: unable to open " + key + " in " + path);
     cnpy::NpyArray arr = cnpy::load_the_npy_file(*stream);
-    juce::Logger::writeToLog("reading npz file:  key: " + key);
-    //juce::Logger::writeToLog("shape: " + vector_to_string(arr.shape));
-    juce::Logger::writeToLog("data: " + vector_to_string_(arr.as_vec<float>()));
-    delete stream;
+
+    if (should_log(LogLevel::entries))
+        juce::Logger::writeToLog("reading npz file:  key: " + key + " shape: " + vector_to_string(std::vector<unsigned long long>(arr.shape.begin(), arr.shape.end())));
+    if (should_log(LogLevel::data) && arr.word_size == sizeof(float))
+        juce::Logger::writeToLog("data: " + vector_to_string_(arr.as_vec<float>()));
     return arr;
 }
 
+cnpy::NpyArray cnpy::read_npz(std::string path, std::string key) {
+    return NpzArchive(path).load(key);
+}
+
 char cnpy::BigEndianTest() {
     int x = 1;
     return (((char *)&x)[0]) ? '<' : '>';
@@ -75,95 +183,29 @@ template<> std::vector<char>& cnpy::operator+=(std::vector<char>& lhs, const cha
 
 void cnpy::parse_npy_header(unsigned char* buffer,size_t& word_size, std::vector<size_t>& shape, bool& fortran_order) {
     //std::string magic_string(buffer,6);
-    uint8_t major_version = *reinterpret_cast<uint8_t*>(buffer+6);
-    uint8_t minor_version = *reinterpret_cast<uint8_t*>(buffer+7);
     uint16_t header_len = *reinterpret_cast<uint16_t*>(buffer+8);
-    std::string header(reinterpret_cast<char*>(buffer+9),header_len);
-
-    size_t loc1, loc2;
-
-    //fortran order
-    loc1 = header.find("fortran_order")+16;
-    fortran_order = (header.substr(loc1,4) == "True" ? true : false);
-
-    //shape
-    loc1 = header.find("(");
-    loc2 = header.find(")");
-
-    std::regex num_regex("[0-9][0-9]*");
-    std::smatch sm;
-    shape.clear();
-
-    std::string str_shape = header.substr(loc1+1,loc2-loc1-1);
-    while(std::regex_search(str_shape, sm, num_regex)) {
-        shape.push_back(std::stoi(sm[0].str()));
-        str_shape = sm.suffix().str();
-    }
-
-    //endian, word size, data type
-    //byte order code | stands for not applicable. 
-    //not sure when this applies except for byte array
-    loc1 = header.find("descr")+9;
-    bool littleEndian = (header[loc1] == '<' || header[loc1] == '|' ? true : false);
-    assert(littleEndian);
-
-    //char type = header[loc1+1];
-    //assert(type == map_type(T));
-
-    std::string str_ws = header.substr(loc1+2);
-    loc2 = str_ws.find("'");
-    word_size = atoi(str_ws.substr(0,loc2).c_str());
+    std::string header(reinterpret_cast<char*>(buffer+10),header_len);
+    parse_header_dict(header, word_size, shape, fortran_order);
 }
 
 void cnpy::parse_npy_header(juce::InputStream& fp, size_t& word_size, std::vector<size_t>& shape, bool& fortran_order) {  
-    char buffer[256];
-	size_t res = fp.read(buffer, 11);
-    if(res != 11)
+    // magic string, format version, then the header length: 2 bytes in
+    // version 1, 4 bytes from version 2 on
+    unsigned char preamble[12];
+    if (fp.read(preamble, 10) != 10 || preamble[0] != 0x93)
         throw std::runtime_error("parse_npy_header: failed fread");
-    std::string header = fp.readNextLine().toStdString();
-    //assert(header[header.size()-1] == '\n');
-
-    size_t loc1, loc2;
-
-    //fortran order
-    loc1 = header.find("fortran_order");
-    if (loc1 == std::string::npos)
-        throw std::runtime_error("parse_npy_header: failed to find header keyword: 'fortran_order'");
-    loc1 += 16;
-    fortran_order = (header.substr(loc1,4) == "True" ? true : false);
-
-    //shape
-    loc1 = header.find("(");
-    loc2 = header.find(")");
-    if (loc1 == std::string::npos || loc2 == std::string::npos)
-        throw std::runtime_error("parse_npy_header: failed to find header keyword: '(' or ')'");
-
-    std::regex num_regex("[0-9][0-9]*");
-    std::smatch sm;
-    shape.clear();
-
-    std::string str_shape = header.substr(loc1+1,loc2-loc1-1);
-    while(std::regex_search(str_shape, sm, num_regex)) {
-        shape.push_back(std::stoi(sm[0].str()));
-        str_shape = sm.suffix().str();
+
+    uint32_t header_len = (uint32_t)preamble[8] | (uint32_t)preamble[9] << 8;
+    if (preamble[6] >= 2) {
+        if (fp.read(preamble + 10, 2) != 2)
+            throw std::runtime_error("parse_npy_header: failed fread");
+        header_len |= (uint32_t)preamble[10] << 16 | (uint32_t)preamble[11] << 24;
     }
 
-    //endian, word size, data type
-    //byte order code | stands for not applicable. 
-    //not sure when this applies except for byte array
-    loc1 = header.find("descr");
-    if (loc1 == std::string::npos)
-        throw std::runtime_error("parse_npy_header: failed to find header keyword: 'descr'");
-    loc1 += 9;
-    bool littleEndian = (header[loc1] == '<' || header[loc1] == '|' ? true : false);
-    assert(littleEndian);
-
-    //char type = header[loc1+1];
-    //assert(type == map_type(T));
-
-    std::string str_ws = header.substr(loc1+2);
-    loc2 = str_ws.find("'");
-    word_size = atoi(str_ws.substr(0,loc2).c_str());
+    std::string header(header_len, '\0');
+    if (fp.read(&header[0], (int)header_len) != (int)header_len)
+        throw std::runtime_error("parse_npy_header: failed fread");
+    parse_header_dict(header, word_size, shape, fortran_order);
 }
 
 void cnpy::parse_zip_footer(FILE* fp, uint16_t& nrecs, size_t& global_header_size, size_t& global_header_offset)
@@ -85,6 +85,36 @@ namespace cnpy {
    
     using npz_t = std::map<std::string, NpyArray>; 
 
+    // what the loaders write to juce::Logger
+    enum class LogLevel {
+        none,
+        archives,   // one line per archive opened
+        entries,    // one line per array decoded
+        data        // the first values of every array decoded
+    };
+
+    void set_log_level(LogLevel level);
+    LogLevel get_log_level();
+
+    // An .npz opened once, with its entries indexed by key (the entry name
+    // without ".npy"). Arrays are only decoded when loaded, straight from the
+    // file into the NpyArray's buffer.
+    class NpzArchive {
+    public:
+        explicit NpzArchive(const std::string& path);
+
+        bool contains(const std::string& key) const;
+        std::vector<std::string> keys() const;
+
+        // throws std::runtime_error if the key is missing or the entry is malformed
+        NpyArray load(const std::string& key);
+
+    private:
+        std::string path;
+        std::unique_ptr<juce::ZipFile> zip;
+        std::map<std::string, int> index;
+    };
+
     char BigEndianTest();
     char map_type(const std::type_info& t);
     template<typename T> std::vector<char> create_npy_header(const std::vector<size_t>& shape);
@@ -96,6 +126,7 @@ namespace cnpy {
 
 
 
+    // opens the archive for a single key; use NpzArchive to read several
     NpyArray read_npz(std::string path, std::string key);
 
     template<typename T> std::vector<char>& operator+=(std::vector<char>& lhs, const T rhs) {
@@ -0,0 +1,262 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+    Created: 17 Oct 2026 3:02:15am
+    Author:  a931e
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include "../../../Source/MFMBank.h"
+
+/*
+ * Compiles a table directory of <midiNote>.npz files into one .mfmbank file,
+ * see PackedBank. Notes are decoded and validated with the plugin's own
+ * MFMParam, on all cores, and their loop tables built, so the plugin only
+ * has to map the result.
+ *
+ *   BankCompiler <table directory> <output.mfmbank> [--precision FILE] [--threads N] [--keep-going] [--verbose]
+ *
+ * By default a note that fails to load fails the whole bank; --keep-going
+ * writes the notes that did load.
+ *
+ * The bank stores each note's arrays and its partial-major float32 loop
+ * tables as the plugin decodes and builds them, and the table format the
+ * plugin applies when it opens the bank: the layout and encodings of
+ * --precision FILE, or else of the directory's precision.txt, in the
+ * syntax of FrameTable::Format::parse(); frame-major float32 without
+ * either. `layout = partialMajor` keeps the tables in the mapping, shared
+ * between processes; otherwise the frame tables are built from it at load.
+ */
+
+namespace
+{
+	struct Options
+	{
+		juce::String input, output, precision;
+		int numThreads = 0;
+		bool keepGoing = false;
+		bool verbose = false;
+	};
+
+	struct NoteResult
+	{
+		int midiNote = 0;
+		juce::int64 fileSize = 0;
+		std::shared_ptr<MFMParam> param;
+		juce::String error;
+		double seconds = 0;
+	};
+
+	using Clock = std::chrono::steady_clock;
+
+	double secondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	juce::String megabytes(double bytes)
+	{
+		return juce::String(bytes / (1024.0 * 1024.0), 2) + " MB";
+	}
+
+	void print(const juce::String& line)
+	{
+		std::printf("%s\n", line.toRawUTF8());
+	}
+
+	bool parseOptions(int argc, char* argv[], Options& options)
+	{
+		juce::StringArray positional;
+		for (int i = 1; i < argc; i++) {
+			const juce::String arg(argv[i]);
+			if (arg == "--threads" && i + 1 < argc) {
+				options.numThreads = juce::String(argv[++i]).getIntValue();
+			}
+			else if (arg == "--precision" && i + 1 < argc) {
+				options.precision = argv[++i];
+			}
+			else if (arg == "--keep-going") {
+				options.keepGoing = true;
+			}
+			else if (arg == "--verbose") {
+				options.verbose = true;
+			}
+			else if (arg.startsWith("--")) {
+				return false;
+			}
+			else {
+				positional.add(arg);
+			}
+		}
+		if (positional.size() != 2) {
+			return false;
+		}
+		options.input = positional[0];
+		options.output = positional[1];
+		if (options.numThreads <= 0) {
+			options.numThreads = juce::jmax(1, (int)std::thread::hardware_concurrency());
+		}
+		return true;
+	}
+
+	// decodes every file, `numThreads` at a time; results are in note order
+	std::vector<NoteResult> loadNotes(const MFMBank::FileMap& files, int numThreads)
+	{
+		std::vector<NoteResult> results;
+		std::vector<std::string> paths;
+		for (const auto& file : files) {
+			NoteResult result;
+			result.midiNote = file.first;
+			result.fileSize = file.second.size;
+			results.push_back(result);
+			paths.push_back(file.second.path);
+		}
+
+		std::atomic<size_t> next{ 0 };
+		auto work = [&] {
+			for (size_t i = next++; i < results.size(); i = next++) {
+				auto& result = results[i];
+				const auto start = Clock::now();
+				try {
+					auto param = std::make_shared<MFMParam>(paths[i]);
+					param->buildLoopTables(MFMBank::loopStartSeconds, MFMBank::loopEndSeconds, MFMBank::overlapSeconds);
+					if (param->magGlobalLoop.isEmpty()) {
+						throw std::runtime_error("too short to loop");
+					}
+					result.param = param;
+				}
+				catch (std::exception& e) {
+					result.error = e.what();
+				}
+				result.seconds = secondsSince(start);
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for (int t = 1; t < std::min<int>(numThreads, (int)results.size()); t++) {
+			threads.emplace_back(work);
+		}
+		work();
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		return results;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	Options options;
+	if (!parseOptions(argc, argv, options)) {
+		print("usage: BankCompiler <table directory> <output.mfmbank> [--precision FILE] [--threads N] [--keep-going] [--verbose]");
+		print("  the plugin stores the tables as --precision FILE, or the directory's precision.txt, says;");
+		print("  frame-major float32 without either");
+		return 2;
+	}
+
+	// the format is checked before decoding anything
+	FrameTable::Format format;
+	const juce::File precisionFile = options.precision.isNotEmpty()
+		? juce::File::getCurrentWorkingDirectory().getChildFile(options.precision)
+		: juce::File::getCurrentWorkingDirectory().getChildFile(options.input).getChildFile(MFMBank::precisionFileName);
+	if (options.precision.isNotEmpty() && !precisionFile.existsAsFile()) {
+		print("error: no precision file " + precisionFile.getFullPathName());
+		return 1;
+	}
+	if (precisionFile.existsAsFile()) {
+		juce::String error;
+		if (!FrameTable::Format::parse(precisionFile.loadFileAsString(), format, error)) {
+			print("error: " + precisionFile.getFileName() + ": " + error);
+			return 1;
+		}
+	}
+	cnpy::set_log_level(options.verbose ? cnpy::LogLevel::archives : cnpy::LogLevel::none);
+
+	MFMBank::FileMap files;
+	try {
+		files = MFMBank::scan(options.input);
+	}
+	catch (std::exception& e) {
+		print("error: unable to list " + options.input + ": " + e.what());
+		return 1;
+	}
+	files.erase(MFMBank::packedBankKey);
+	if (files.empty()) {
+		print("error: no <midiNote>.npz files in " + options.input);
+		return 1;
+	}
+
+	const auto loadStart = Clock::now();
+	auto results = loadNotes(files, options.numThreads);
+	const double loadSeconds = secondsSince(loadStart);
+
+	MFMBank::ParamMap params;
+	juce::int64 sourceBytes = 0;
+	double cpuSeconds = 0, slowest = 0;
+	int minPartials = 0, maxPartials = 0, numFailed = 0;
+	size_t numFrames = 0;
+	for (const auto& result : results) {
+		sourceBytes += result.fileSize;
+		cpuSeconds += result.seconds;
+		slowest = std::max(slowest, result.seconds);
+		if (result.param == nullptr) {
+			numFailed++;
+			print("error: " + juce::String(result.midiNote) + ".npz: " + result.error);
+			continue;
+		}
+		const auto& param = *result.param;
+		minPartials = params.empty() ? param.num_partials : std::min(minPartials, param.num_partials);
+		maxPartials = std::max(maxPartials, param.num_partials);
+		numFrames += (size_t)param.num_partials * param.num_samples;
+		params[result.midiNote] = result.param;
+		if (options.verbose) {
+			print("  note " + juce::String(result.midiNote) + ": " + juce::String(param.num_partials) + " partials x "
+				+ juce::String(param.num_samples) + " frames at " + juce::String(param.param_sr) + " Hz, "
+				+ juce::String(result.seconds * 1000, 1) + " ms");
+		}
+	}
+
+	print("loaded " + juce::String((int)params.size()) + " of " + juce::String((int)results.size()) + " notes ("
+		+ megabytes((double)sourceBytes) + ") in " + juce::String(loadSeconds, 2) + " s on "
+		+ juce::String(options.numThreads) + " threads; " + juce::String(cpuSeconds, 2) + " s decoding, slowest note "
+		+ juce::String(slowest * 1000, 0) + " ms");
+	if (params.empty() || (numFailed > 0 && !options.keepGoing)) {
+		print("error: " + juce::String(numFailed) + " notes failed, nothing written" + (params.empty() ? "" : " (use --keep-going to skip them)"));
+		return 1;
+	}
+	print("partials per note: " + juce::String(minPartials) + ".." + juce::String(maxPartials) + ", "
+		+ juce::String((juce::int64)numFrames) + " partial frames in total");
+	print("table format: " + format.toString());
+
+	const auto writeStart = Clock::now();
+	const juce::File output = juce::File::getCurrentWorkingDirectory().getChildFile(options.output);
+	juce::String error;
+	if (!MFMBank::writePacked(params, output, format, error)) {
+		print("error: " + error);
+		return 1;
+	}
+	const double writeSeconds = secondsSince(writeStart);
+
+	// check the result the way the plugin will open it
+	const auto openStart = Clock::now();
+	auto pack = PackedBank::open(output, error);
+	if (pack == nullptr || pack->getNumNotes() != (int)params.size()) {
+		print("error: the written bank does not open: " + error);
+		return 1;
+	}
+	const double openSeconds = secondsSince(openStart);
+
+	const double outputBytes = (double)output.getSize();
+	print("wrote " + output.getFullPathName() + ": " + megabytes(outputBytes) + " ("
+		+ juce::String(outputBytes / juce::jmax<double>(1, (double)sourceBytes), 2) + "x the source) in "
+		+ juce::String(writeSeconds, 2) + " s; opens in " + juce::String(openSeconds * 1000, 1) + " ms");
+	return 0;
+}
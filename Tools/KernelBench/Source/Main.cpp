@@ -0,0 +1,690 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+    Created: 17 Oct 2026 9:12:40am
+    Author:  a931e
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "../../../Source/PartialBank.h"
+#include "../../../Source/SpectralEngine.h"
+
+#if JUCE_LINUX
+ #include <linux/perf_event.h>
+ #include <sys/ioctl.h>
+ #include <sys/syscall.h>
+ #include <unistd.h>
+#endif
+
+/*
+ * Measurements behind the numbers the render kernels document, on synthetic
+ * notes so no table directory is needed:
+ *
+ *   KernelBench recurrence [--partials N]
+ *       worst difference between the recurrence and the direct kernel per
+ *       block, per unit of sum |mag * magControl| (PartialBank), and the
+ *       phase drift between the two modes over two seconds
+ *
+ *   KernelBench spectral [--partials N]
+ *       time per output sample of the direct and recurrence kernels and of
+ *       the inverse-FFT engine (SpectralEngine) for 8, 16, ... up to N
+ *       partials (default 1024), and the first count at which the engine
+ *       is the faster
+ *
+ *   KernelBench frames [--partials N]
+ *       time and, on Linux, L1d and last-level cache misses per frame load
+ *       (PartialBank::loadFrame) of 16 voices on 16 notes of N partials
+ *       (default 128), from the partial-major LoopTables and from a
+ *       FrameTable in each encoding; see FrameTable::Layout
+ *
+ *   KernelBench tables [--partials N]
+ *       accuracy of the derived tables of notes of N partials (default 128):
+ *       the worst error of breakpoint fits (BreakpointTable) at several
+ *       tolerances, which must stay within the tolerance, with their size
+ *       and the frames the cursors of PartialBank::loadFrame() read wrong;
+ *       and the worst difference between a loop table blended from two
+ *       notes' frame tables (as MFMParam blends notes) and one built from
+ *       the blended sources. Exits with 1 if a fit exceeds its tolerance.
+ *
+ *   KernelBench grow [--partials N]
+ *       renders a note of N partials (default 64) twice, growing one of the
+ *       two banks to twice the capacity halfway (PartialBank::grow(), as
+ *       SynthVoice::growNoteState() does when a bank with larger notes is
+ *       published), and exits with 1 unless the outputs are sample-identical
+ */
+
+namespace
+{
+	constexpr double sampleRate = 48000;
+	constexpr int paramSr = 100;
+	constexpr int blockSize = 512;
+
+	void print(const juce::String& line)
+	{
+		std::printf("%s\n", line.toRawUTF8());
+	}
+
+	/**
+	 * A harmonic note of `numPartials` partials with the magnitudes, phase
+	 * offsets and modulators of a typical bowed note, the same for every
+	 * `seed`. The modulation bounds are kept within what the recurrence
+	 * kernel accepts, so every block can be rendered both ways.
+	 */
+	void fillNote(PartialBank& partials, int numPartials, float fundamental, unsigned int seed)
+	{
+		std::mt19937 random(seed);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		partials.allocate(numPartials);
+		partials.reset(numPartials);
+		const float dt = (float)(1 / sampleRate);
+		for (int i = 0; i < numPartials; i++) {
+			partials.carrierInc[i] = fundamental * dt * (i + 1);
+			partials.carrierPhase[i] = unit(random) - 0.5f;
+			partials.magStart[i] = 0.5f * unit(random) / (i + 1);
+			partials.magSlope[i] = 0.01f * (unit(random) - 0.5f) * partials.magStart[i];
+			partials.alphaGlobalStart[i] = 6 * unit(random) - 3;
+			partials.alphaGlobalSlope[i] = 0.02f * (unit(random) - 0.5f);
+			partials.env1Start[i] = 0.2f * unit(random);
+			partials.env2Start[i] = 0.2f * unit(random);
+			partials.modPhase1[i] = -0.5f;
+			partials.modPhase2[i] = -0.5f;
+			partials.modInc1[i] = (2 + 4 * unit(random)) * dt;
+			partials.modInc2[i] = (2 + 4 * unit(random)) * dt;
+			partials.modDepth1[i] = unit(random);
+			partials.modDepth2[i] = unit(random);
+			partials.modGain1[i] = unit(random);
+			partials.modGain2[i] = unit(random);
+			partials.noise1[i] = unit(random) - 0.5f;
+			partials.noise2[i] = unit(random) - 0.5f;
+			partials.magControl[i] = 1;
+			partials.alphaLocalBound[i] = partials.modGain1[i] * 0.2f + partials.modGain2[i] * 0.2f;
+			partials.alphaGlobalRate[i] = 0.01f;
+		}
+	}
+
+	float getTotalMagnitude(const PartialBank& partials)
+	{
+		float total = 0;
+		for (int i = 0; i < partials.getNumPartials(); i++) {
+			total += std::abs(partials.magStart[i] * partials.magControl[i]);
+		}
+		return total;
+	}
+
+	int recurrence(int numPartials)
+	{
+		const float fundamental = 220;
+		const float tableStep = (float)(paramSr / sampleRate);
+		const int numBlocks = (int)(2 * sampleRate / blockSize);
+
+		PartialBank direct, recurrent;
+		fillNote(direct, numPartials, fundamental, 1);
+		fillNote(recurrent, numPartials, fundamental, 1);
+		const float totalMagnitude = getTotalMagnitude(direct);
+
+		// per block, from the same carrier phases
+		double worst = 0, sumSquares = 0;
+		long long numSamples = 0;
+		int numRejected = 0;
+		for (int block = 0; block < numBlocks; block++) {
+			std::copy(direct.carrierPhase, direct.carrierPhase + numPartials, recurrent.carrierPhase);
+			std::copy(direct.modPhase1, direct.modPhase1 + numPartials, recurrent.modPhase1);
+			std::copy(direct.modPhase2, direct.modPhase2 + numPartials, recurrent.modPhase2);
+			// stay within one frame, as between two loadFrame() calls
+			const float blockFrac = std::fmod(block * 0.37f, 1.0f - tableStep * blockSize);
+			direct.beginBlock(blockSize, 1e-3f, numPartials);
+			recurrent.beginBlock(blockSize, 1e-3f, numPartials);
+			if (!recurrent.beginRecurrenceBlock(blockFrac, 1.0f, tableStep * blockSize + 1)) {
+				numRejected++;
+				direct.endBlock(blockSize);
+				recurrent.endBlock(blockSize);
+				continue;
+			}
+			for (int sample = 0; sample < blockSize; sample++) {
+				const float frac = blockFrac + tableStep * sample;
+				const double error = std::abs(direct.renderSample(frac, 1.0f) - recurrent.renderSampleRecurrence(frac, 1.0f)) / totalMagnitude;
+				worst = std::max(worst, error);
+				sumSquares += error * error;
+				numSamples++;
+			}
+			recurrent.advanceCarriers(blockSize);
+			direct.endBlock(blockSize);
+			recurrent.endBlock(blockSize);
+		}
+
+		// without re-syncing: how far the phases of the two modes drift apart
+		PartialBank directRun, recurrentRun;
+		fillNote(directRun, numPartials, fundamental, 2);
+		fillNote(recurrentRun, numPartials, fundamental, 2);
+		for (int block = 0; block < numBlocks; block++) {
+			directRun.beginBlock(blockSize, 1e-3f, numPartials);
+			for (int sample = 0; sample < blockSize; sample++) {
+				directRun.renderSample(0, 1.0f);
+			}
+			directRun.endBlock(blockSize);
+			recurrentRun.beginBlock(blockSize, 1e-3f, numPartials);
+			recurrentRun.advanceCarriers(blockSize);
+			recurrentRun.endBlock(blockSize);
+		}
+		double drift = 0;
+		int driftPartial = 0;
+		for (int i = 0; i < numPartials; i++) {
+			const double difference = directRun.carrierPhase[i] - recurrentRun.carrierPhase[i];
+			const double wrapped = std::abs(difference - std::nearbyint(difference));
+			if (wrapped > drift) {
+				drift = wrapped;
+				driftPartial = i + 1;
+			}
+		}
+
+		print("recurrence vs direct, " + juce::String(numPartials) + " partials of " + juce::String(fundamental) + " Hz, "
+			+ juce::String(numBlocks) + " blocks of " + juce::String(blockSize) + " samples (" + juce::String(numRejected) + " rejected):");
+		print("  per unit of sum |mag * magControl|: max " + juce::String(worst, 8) + ", rms "
+			+ juce::String(std::sqrt(sumSquares / std::max(1LL, numSamples)), 8));
+		print("  phase drift after " + juce::String(numBlocks * blockSize / sampleRate, 2) + " s: "
+			+ juce::String(drift, 6) + " cycles (partial " + juce::String(driftPartial) + ")");
+		return 0;
+	}
+
+	/** Seconds per call of `render`, which renders one block, over about a quarter of a second. */
+	template <typename Render>
+	double timeBlocks(Render render)
+	{
+		using Clock = std::chrono::steady_clock;
+		for (int i = 0; i < 4; i++) {
+			render();
+		}
+		long long numCalls = 0;
+		const auto start = Clock::now();
+		double elapsed = 0;
+		do {
+			for (int i = 0; i < 8; i++) {
+				render();
+			}
+			numCalls += 8;
+			elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		} while (elapsed < 0.25);
+		return elapsed / (double)numCalls;
+	}
+
+	int spectral(int maxPartials)
+	{
+		const int tableLength = 200;
+		const char* names[] = { "direct", "recurrence", "spectral" };
+		int crossovers[2] = { 0, 0 };
+		volatile float sink = 0;
+
+		print("ns per output sample, " + juce::String(blockSize) + "-sample blocks, hop " + juce::String(SpectralEngine::hopSize) + ":");
+		print("  partials      direct  recurrence    spectral");
+		for (int numPartials = 8; numPartials <= maxPartials; numPartials *= 2) {
+			// every partial below Nyquist, so none is culled or skipped
+			const float fundamental = std::min(220.0f, (float)(0.45 * sampleRate / numPartials));
+			std::mt19937 random(3);
+			std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+			std::vector<float> source((size_t)numPartials * tableLength);
+			LoopTable tables[FrameTable::numQuantities];
+			for (auto& table : tables) {
+				for (auto& value : source) {
+					value = unit(random);
+				}
+				table.build(source.data(), numPartials, tableLength, tableLength, tableLength / 2, tableLength, 0);
+			}
+
+			PartialBank partials;
+			SpectralEngine engine;
+			engine.allocate(numPartials);
+			double seconds[3];
+
+			fillNote(partials, numPartials, fundamental, 4);
+			seconds[0] = timeBlocks([&] {
+				partials.beginBlock(blockSize, 1e-3f, numPartials);
+				float y = 0;
+				for (int sample = 0; sample < blockSize; sample++) {
+					y += partials.renderSample(0.5f, 1.0f);
+				}
+				partials.endBlock(blockSize);
+				sink = y;
+			});
+
+			fillNote(partials, numPartials, fundamental, 4);
+			seconds[1] = timeBlocks([&] {
+				partials.beginBlock(blockSize, 1e-3f, numPartials);
+				float y = 0;
+				if (partials.beginRecurrenceBlock(0.0f, 1.0f, 1.0f)) {
+					for (int sample = 0; sample < blockSize; sample++) {
+						y += partials.renderSampleRecurrence(0.0f, 1.0f);
+					}
+				}
+				partials.advanceCarriers(blockSize);
+				partials.endBlock(blockSize);
+				sink = y;
+			});
+
+			// as SynthVoice renders a spectral block, see renderSpectralFrame()
+			fillNote(partials, numPartials, fundamental, 4);
+			engine.reset();
+			double position = 0;
+			seconds[2] = timeBlocks([&] {
+				partials.beginBlock(blockSize, 1e-3f, numPartials);
+				float y = 0;
+				for (int sample = 0; sample < blockSize; sample++) {
+					if (engine.needsFrame()) {
+						position = tables[0].wrap(position + 0.5);
+						partials.evaluate(tables[0], tables[1], tables[2], tables[3], position, sample + SpectralEngine::hopSize + 1, 1.0f,
+							engine.amplitude.get(), engine.phase.get());
+						engine.synthesiseFrame(partials.carrierInc, numPartials);
+					}
+					y += engine.getNextSample();
+				}
+				partials.advanceCarriers(blockSize);
+				partials.advanceModulators(blockSize);
+				partials.endBlock(blockSize);
+				sink = y;
+			});
+
+			juce::String line = "  " + juce::String(numPartials).paddedLeft(' ', 8);
+			for (double s : seconds) {
+				line += juce::String(s / blockSize * 1e9, 1).paddedLeft(' ', 12);
+			}
+			print(line);
+			for (int k = 0; k < 2; k++) {
+				if (crossovers[k] == 0 && seconds[2] < seconds[k]) {
+					crossovers[k] = numPartials;
+				}
+			}
+		}
+		for (int k = 0; k < 2; k++) {
+			print("  spectral beats " + juce::String(names[k]) + ": "
+				+ (crossovers[k] > 0 ? "from " + juce::String(crossovers[k]) + " partials" : juce::String("not up to ") + juce::String(maxPartials)));
+		}
+		return 0;
+	}
+
+	/** Hardware cache misses of this thread where the OS exposes them (Linux perf events). */
+	class CacheMissCounter
+	{
+	public:
+		enum Level { l1d, lastLevel, numLevels };
+
+		CacheMissCounter()
+		{
+#if JUCE_LINUX
+			const juce::uint64 configs[numLevels] = {
+				PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+				PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+			};
+			for (int level = 0; level < numLevels; level++) {
+				perf_event_attr attr = {};
+				attr.type = PERF_TYPE_HW_CACHE;
+				attr.size = sizeof(attr);
+				attr.config = configs[level];
+				attr.disabled = 1;
+				attr.exclude_kernel = 1;
+				attr.exclude_hv = 1;
+				fds[level] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+			}
+#endif
+		}
+
+		~CacheMissCounter()
+		{
+#if JUCE_LINUX
+			for (int fd : fds) {
+				if (fd >= 0) {
+					close(fd);
+				}
+			}
+#endif
+		}
+
+		CacheMissCounter(const CacheMissCounter&) = delete;
+		CacheMissCounter& operator=(const CacheMissCounter&) = delete;
+
+		bool isAvailable(Level level) const { return fds[level] >= 0; }
+
+		void start()
+		{
+#if JUCE_LINUX
+			for (int fd : fds) {
+				if (fd >= 0) {
+					ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+					ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+				}
+			}
+#endif
+		}
+
+		/** The misses at `level` since start(); stops counting. */
+		long long stop(Level level)
+		{
+			long long count = 0;
+#if JUCE_LINUX
+			if (fds[level] >= 0) {
+				ioctl(fds[level], PERF_EVENT_IOC_DISABLE, 0);
+				if (read(fds[level], &count, sizeof(count)) != (ssize_t)sizeof(count)) {
+					count = 0;
+				}
+			}
+#endif
+			return count;
+		}
+
+	private:
+		int fds[numLevels] = { -1, -1 };
+	};
+
+	int frames(int numPartials)
+	{
+		constexpr int numVoices = 16;
+		constexpr int numLoads = 20000;
+		const int tableLength = 1000;
+		// frames a voice moves on between two loads: one block at the parameter rate
+		const double framesPerLoad = blockSize * paramSr / sampleRate;
+
+		std::mt19937 random(5);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		std::vector<float> source((size_t)numPartials * tableLength);
+		LoopTable tables[numVoices][FrameTable::numQuantities];
+		for (auto& note : tables) {
+			for (auto& table : note) {
+				for (auto& value : source) {
+					value = unit(random) - 0.5f;
+				}
+				table.build(source.data(), numPartials, tableLength, tableLength, tableLength / 4, tableLength, tableLength / 8);
+			}
+		}
+
+		PartialBank partials[numVoices];
+		for (auto& bank : partials) {
+			bank.allocate(numPartials);
+			bank.reset(numPartials);
+		}
+		CacheMissCounter counter;
+		const FrameTable::Encoding encodings[] = { FrameTable::Encoding::float32, FrameTable::Encoding::float16, FrameTable::Encoding::int16 };
+
+		print("per frame load of " + juce::String(numPartials) + " partials, " + juce::String(numVoices) + " voices on "
+			+ juce::String(numVoices) + " notes of " + juce::String(tableLength) + " frames:");
+		print("  layout                  ns  L1d misses   LL misses");
+		for (int layout = -1; layout < (int)(sizeof(encodings) / sizeof(encodings[0])); layout++) {
+			// layout -1 is the partial-major LoopTables
+			std::vector<std::unique_ptr<FrameTable>> frameTables;
+			juce::String name = "partial-major";
+			if (layout >= 0) {
+				FrameTable::Format format;
+				for (auto& encoding : format.encodings) {
+					encoding = encodings[layout];
+				}
+				for (auto& note : tables) {
+					frameTables.push_back(std::make_unique<FrameTable>());
+					frameTables.back()->build(note[0], note[1], note[2], note[3], format);
+				}
+				name = juce::String("frame-major ") + FrameTable::Format::getName(encodings[layout]);
+			}
+
+			double positions[numVoices];
+			for (int v = 0; v < numVoices; v++) {
+				positions[v] = tables[v][0].getLoopEnd() * unit(random);
+			}
+			auto run = [&](int count) {
+				for (int load = 0; load < count; load++) {
+					const int v = load % numVoices;
+					const int frame = (int)positions[v];
+					if (layout < 0) {
+						partials[v].loadFrame(tables[v][0], tables[v][1], tables[v][2], tables[v][3], frame);
+					}
+					else {
+						partials[v].loadFrame(*frameTables[v], frame);
+					}
+					positions[v] = tables[v][0].wrap(positions[v] + framesPerLoad);
+				}
+			};
+			run(numLoads / 10);
+
+			using Clock = std::chrono::steady_clock;
+			counter.start();
+			const auto start = Clock::now();
+			run(numLoads);
+			const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+			const long long l1dMisses = counter.stop(CacheMissCounter::l1d);
+			const long long lastLevelMisses = counter.stop(CacheMissCounter::lastLevel);
+
+			auto perLoad = [&counter, numLoads](CacheMissCounter::Level level, long long misses) {
+				return counter.isAvailable(level) ? juce::String((double)misses / numLoads, 1) : juce::String("n/a");
+			};
+			print("  " + name.paddedRight(' ', 20) + juce::String(seconds / numLoads * 1e9, 0).paddedLeft(' ', 6)
+				+ perLoad(CacheMissCounter::l1d, l1dMisses).paddedLeft(' ', 12)
+				+ perLoad(CacheMissCounter::lastLevel, lastLevelMisses).paddedLeft(' ', 12));
+		}
+		return 0;
+	}
+
+	/**
+	 * A slowly varying track as the analysis produces them: a decay, a slow
+	 * swell and a vibrato-like wobble, plus a little noise, different per
+	 * partial and `seed`.
+	 */
+	void fillTrack(float* track, int length, int partial, unsigned int seed)
+	{
+		std::mt19937 random(seed * 1000 + (unsigned int)partial);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		const float level = 0.2f + unit(random), decay = 100 + 400 * unit(random);
+		const float swell = 0.3f * unit(random), swellPeriod = 200 + 300 * unit(random);
+		const float wobble = 0.05f * unit(random), wobblePeriod = 15 + 10 * unit(random);
+		for (int f = 0; f < length; f++) {
+			track[f] = level * std::exp(-f / decay) + swell * std::sin(juce::MathConstants<float>::twoPi * f / swellPeriod)
+				+ wobble * std::sin(juce::MathConstants<float>::twoPi * f / wobblePeriod) + 1e-4f * (unit(random) - 0.5f);
+		}
+	}
+
+	int tables(int numPartials)
+	{
+		const int tableLength = 200;
+		const int loopStart = 40, loopEnd = 125, overlap = 50;
+		int status = 0;
+
+		std::vector<float> sources[2];
+		LoopTable notes[2][FrameTable::numQuantities];
+		for (int n = 0; n < 2; n++) {
+			sources[n].resize((size_t)FrameTable::numQuantities * numPartials * tableLength);
+			for (int q = 0; q < FrameTable::numQuantities; q++) {
+				float* source = sources[n].data() + (size_t)q * numPartials * tableLength;
+				for (int p = 0; p < numPartials; p++) {
+					fillTrack(source + (size_t)p * tableLength, tableLength, p, (unsigned int)(n * FrameTable::numQuantities + q + 1));
+				}
+				notes[n][q].build(source, numPartials, tableLength, tableLength, loopStart, loopEnd, overlap);
+			}
+		}
+
+		const LoopTable& table = notes[0][FrameTable::mag];
+		print("breakpoint fits of " + juce::String(numPartials) + " partials, " + juce::String(table.getLength()) + " frames each:");
+		print("  tolerance  worst error  breakpoints  of frames   cursor misses");
+		for (float tolerance : { 0.0001f, FrameTable::defaultTolerance, 0.01f }) {
+			BreakpointTable fit;
+			fit.build(table, tolerance);
+			double worst = 0;
+			for (int p = 0; p < numPartials; p++) {
+				for (int f = 0; f < table.getLength(); f++) {
+					worst = std::max(worst, (double)std::abs(fit.interpolate(p, f) - table.getPartial(p)[f]) / table.getMaxAbs(p));
+				}
+			}
+
+			// the frames a voice loads, one block apart, through the loop twice
+			std::vector<int> segments((size_t)numPartials, -1);
+			std::vector<float> start((size_t)numPartials), slope((size_t)numPartials);
+			const double framesPerLoad = blockSize * paramSr / sampleRate;
+			int misses = 0;
+			double position = 0;
+			for (int load = 0; load < (int)(2 * table.getLength() / framesPerLoad); load++) {
+				const int frame = (int)position;
+				fit.load(frame, segments.data(), start.data(), slope.data(), numPartials);
+				for (int p = 0; p < numPartials; p++) {
+					if (std::abs(start[p] - fit.interpolate(p, frame)) > 1e-6f * table.getMaxAbs(p)) {
+						misses++;
+					}
+				}
+				position = table.wrap(position + framesPerLoad);
+			}
+
+			// float rounding of the fitted values only
+			const bool ok = worst <= tolerance * (1 + 1e-3) + 1e-6;
+			if (!ok || misses > 0) {
+				status = 1;
+			}
+			const int frames = numPartials * table.getLength();
+			print("  " + juce::String(tolerance, 4).paddedLeft(' ', 9) + juce::String(worst, 7).paddedLeft(' ', 13)
+				+ juce::String(fit.getNumBreakpoints()).paddedLeft(' ', 13) + (juce::String(100.0 * fit.getNumBreakpoints() / frames, 1) + "%").paddedLeft(' ', 11)
+				+ juce::String(misses).paddedLeft(' ', 16) + (ok ? "" : "  EXCEEDS TOLERANCE"));
+		}
+
+		// as MFMParam blends two notes whose frames moved to frame tables
+		FrameTable frameTables[2];
+		for (int n = 0; n < 2; n++) {
+			frameTables[n].build(notes[n][0], notes[n][1], notes[n][2], notes[n][3], {});
+		}
+		const float weight = 0.3f;
+		std::vector<float> blendedSource((size_t)numPartials * tableLength);
+		double worstBlend = 0;
+		for (int q = 0; q < FrameTable::numQuantities; q++) {
+			const size_t offset = (size_t)q * numPartials * tableLength;
+			for (size_t i = 0; i < blendedSource.size(); i++) {
+				blendedSource[i] = sources[0][offset + i] + (sources[1][offset + i] - sources[0][offset + i]) * weight;
+			}
+			LoopTable expected, blended;
+			expected.build(blendedSource.data(), numPartials, tableLength, tableLength, loopStart, loopEnd, overlap);
+			blended.build(notes[0][q], numPartials, [&](int p, int frame) {
+				const float a = frameTables[0].getValue(frame, (FrameTable::Quantity)q, p);
+				return a + (frameTables[1].getValue(frame, (FrameTable::Quantity)q, p) - a) * weight;
+			});
+			for (int p = 0; p < numPartials; p++) {
+				for (int f = 0; f < expected.getLength(); f++) {
+					worstBlend = std::max(worstBlend, (double)std::abs(blended.getPartial(p)[f] - expected.getPartial(p)[f]) / expected.getMaxAbs(p));
+				}
+			}
+		}
+		print("blend of two notes' tables at " + juce::String(weight, 1) + " vs tables of the blended sources: worst difference "
+			+ juce::String(worstBlend, 9) + " of the partial's largest |value|");
+		return status;
+	}
+
+	int grow(int numPartials)
+	{
+		const int tableLength = 200;
+		const int numBlocks = 200;
+		const double framesPerBlock = blockSize * paramSr / sampleRate;
+		const float tableStep = (float)(paramSr / sampleRate);
+
+		// breakpoints and float16, so the segment cursors and the culling carry state across blocks
+		std::vector<float> source((size_t)numPartials * tableLength);
+		LoopTable tables[FrameTable::numQuantities];
+		for (int q = 0; q < FrameTable::numQuantities; q++) {
+			for (int p = 0; p < numPartials; p++) {
+				fillTrack(source.data() + (size_t)p * tableLength, tableLength, p, (unsigned int)q + 7);
+			}
+			tables[q].build(source.data(), numPartials, tableLength, tableLength, tableLength / 4, tableLength, tableLength / 8);
+		}
+		FrameTable::Format format;
+		format.set(FrameTable::mag, FrameTable::Encoding::breakpoints, FrameTable::defaultTolerance);
+		format.set(FrameTable::alphaGlobal, FrameTable::Encoding::float16, FrameTable::defaultTolerance);
+		FrameTable frameTable;
+		frameTable.build(tables[0], tables[1], tables[2], tables[3], format);
+
+		PartialBank banks[2];
+		for (auto& bank : banks) {
+			fillNote(bank, numPartials, 220, 6);
+		}
+		double position = 0;
+		float worst = 0;
+		for (int block = 0; block < numBlocks; block++) {
+			if (block == numBlocks / 2) {
+				PartialBank larger;
+				larger.allocate(2 * numPartials);
+				banks[1].grow(larger);
+			}
+			const int frame = (int)position;
+			const float frac = (float)(position - frame);
+			float outputs[2][blockSize];
+			for (int b = 0; b < 2; b++) {
+				banks[b].loadFrame(frameTable, frame);
+				banks[b].beginBlock(blockSize, 1e-3f, numPartials);
+				// both kernels, so the recurrence state is carried across too
+				if (block % 2 == 1 && banks[b].beginRecurrenceBlock(frac, 1.0f, (float)framesPerBlock + 1)) {
+					for (int sample = 0; sample < blockSize; sample++) {
+						outputs[b][sample] = banks[b].renderSampleRecurrence(frac + tableStep * sample, 1.0f);
+					}
+					banks[b].advanceCarriers(blockSize);
+				}
+				else {
+					for (int sample = 0; sample < blockSize; sample++) {
+						outputs[b][sample] = banks[b].renderSample(frac + tableStep * sample, 1.0f);
+					}
+				}
+				banks[b].endBlock(blockSize);
+			}
+			for (int sample = 0; sample < blockSize; sample++) {
+				worst = std::max(worst, std::abs(outputs[0][sample] - outputs[1][sample]));
+			}
+			position = tables[0].wrap(position + framesPerBlock);
+		}
+
+		print("note of " + juce::String(numPartials) + " partials, " + juce::String(numBlocks) + " blocks, grown to "
+			+ juce::String(banks[1].getCapacity()) + " partials after block " + juce::String(numBlocks / 2) + ": "
+			+ (worst == 0 ? juce::String("sample-identical") : "differs by up to " + juce::String(worst, 9)));
+		return worst == 0 ? 0 : 1;
+	}
+
+	void printUsage()
+	{
+		print("usage: KernelBench recurrence [--partials N]");
+		print("       KernelBench spectral [--partials N]");
+		print("       KernelBench frames [--partials N]");
+		print("       KernelBench tables [--partials N]");
+		print("       KernelBench grow [--partials N]");
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2) {
+		printUsage();
+		return 2;
+	}
+	const juce::String command(argv[1]);
+	int numPartials = 0;
+	for (int i = 2; i < argc; i++) {
+		const juce::String arg(argv[i]);
+		if (arg == "--partials" && i + 1 < argc) {
+			numPartials = juce::jmax(1, juce::String(argv[++i]).getIntValue());
+		}
+		else {
+			printUsage();
+			return 2;
+		}
+	}
+
+	if (command == "recurrence") {
+		return recurrence(numPartials > 0 ? numPartials : 64);
+	}
+	if (command == "spectral") {
+		return spectral(numPartials > 0 ? numPartials : 1024);
+	}
+	if (command == "frames") {
+		return frames(numPartials > 0 ? numPartials : 128);
+	}
+	if (command == "tables") {
+		return tables(numPartials > 0 ? numPartials : 128);
+	}
+	if (command == "grow") {
+		return grow(numPartials > 0 ? numPartials : 64);
+	}
+	printUsage();
+	return 2;
+}